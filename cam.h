@@ -10,22 +10,46 @@
 #include "ns3/netanim-module.h"
 #include "ns3/udp-echo-server.h"
 #include <vector>   
+#include <map>
 #include <opencv2/opencv.hpp>
+#include "cam_trace.h"
+#include "cam_clustering.h"
+#include "cluster_feed.h"
+#include "motion_predictor.h"
+#include "cluster_addressing.h"
+#include "cluster_index.h"
+#include "cluster_broadcast.h"
 
 
 
 
 using namespace ns3;
 
-struct CAMData {
-    double posX;
-    double posY;
-    double speed;
-    uint32_t idz;
-};
-
 std::vector<std::vector<CAMData>> globalCAMData;
 
+// When open, every CAM received by an RSU is appended to this log
+CAMTraceWriter globalCAMTrace;
+
+// When open, every clustering epoch is published to this shared memory feed
+ClusterFeedWriter globalClusterFeed;
+
+// When enabled, vehicles are re-addressed into the prefix of their cluster
+ClusterAddressing globalClusterAddressing;
+
+// Cluster of every vehicle, kept up to date by the RSUs and readable by the
+// controller and the applications
+ClusterIndex<> globalClusterIndex;
+
+// File name prefix of the per-cluster CSVs of the final clustering, processes
+// sharing a working directory need different ones
+std::string globalClusterCSVPrefix = "cluster";
+
+// EtherTypes of the CAMs and of the downlink broadcasts when they are sent
+// straight over the 802.11p device instead of UDP (IEEE 802 local
+// experimental EtherTypes)
+const uint16_t CAM_PROTOCOL = 0x88b5;
+const uint16_t CLUSTER_DOWNLINK_PROTOCOL = 0x88b6;
+
 
 
 
@@ -38,11 +62,21 @@ class CAMServer : public Application{
         void UpdateGlobalCAMData();
         void SetLocal(Ptr<Socket> socket);
         void SetLocal(Ipv4Address ip, uint16_t port);
+        // Receives the CAMs as CAM_PROTOCOL frames on the 802.11p device,
+        // for vehicles without an IP stack. The downlink uses the device too.
+        void SetLocal(Ptr<NetDevice> device);
         void SetNumRSUs(uint32_t numRSUs);
         std::vector<CAMData> GetCAMData();
         std::vector<size_t> AssignVehiclesToClusters();
         void SetSwitch(Ipv4Address ip, uint16_t port);
         void SendClusters(cv::Mat centers);
+        void ReceiveCAM(const uint8_t* payload, uint32_t length);
+        void SetClusteringEngine(std::shared_ptr<ClusteringEngine> engine);
+        void SetEpochInterval(Time interval);
+        void SetClusteringDeadline(Time deadline, bool wallClock);
+        void SetPrediction(double tolerance, uint32_t maxPredictedEpochs);
+        void SetDownlink(uint16_t port);
+        ClusteringResult RunClustering(const std::vector<CAMData>& cams);
     protected:
         static uint32_t numStoppedRSUs;
         virtual void StopApplication() override;
@@ -50,15 +84,79 @@ class CAMServer : public Application{
     private:
         virtual void StartApplication();
         void HandleRead(Ptr<Socket> socket);
+        void RunEpoch();
+        bool CanPredict(const std::vector<CAMData>& cams) const;
+        void PublishClusters(const std::vector<CAMData>& cams, const ClusteringResult& result);
+        void AssignAddresses(const std::vector<CAMData>& cams, const ClusteringResult& result);
+        void BroadcastClusters(const std::vector<CAMData>& cams, const ClusteringResult& result);
+        void SendDownlink(std::vector<std::vector<uint8_t>> frames);
+        void SendClusterUpdate(const std::vector<CAMData>& cams, const ClusteringResult& result);
+        void CloseSwitchSocket();
         std::vector<CAMData> m_camData;
         Ptr<Socket> m_socket;
         Ipv4Address m_localIp;
         uint16_t m_localPort;
+        Ptr<NetDevice> m_localDevice;
         uint32_t m_numRSUs;
         Ipv4Address m_switchIp;
         uint16_t m_switchPort;
+        Ptr<Socket> m_switchSocket;
+        std::shared_ptr<ClusteringEngine> m_engine;
+
+        // Periodic clustering of the CAMs received during each epoch
+        Time m_epochInterval;
+        EventId m_epochEvent;
+        uint32_t m_epoch;
+        std::map<uint32_t, CAMData> m_epochCAMs; // latest CAM per vehicle
+
+        // Clustering deadline. In wall-clock mode the engine is stopped after
+        // m_deadline of real time; otherwise it gets m_deadline / m_workUnitCost
+        // work units of simulated compute. m_lastLatency is the compute time
+        // of the last run, after which its result is sent.
+        Time m_deadline;
+        bool m_wallClockDeadline;
+        Time m_workUnitCost;
+        Time m_lastLatency;
+
+        // Predictive clustering. While every CAM lands within
+        // m_predictionTolerance metres of its track's prediction and no
+        // vehicle joins or leaves, epochs move the last clusters along with
+        // the predicted positions instead of clustering again. Updates carry
+        // the velocity of every center and the receiver extrapolates them, so
+        // a predicted epoch only sends when its centers drift further than
+        // the tolerance from that extrapolation. A full clustering, which
+        // always sends, runs at least every m_maxPredictedEpochs.
+        double m_predictionTolerance;
+        uint32_t m_maxPredictedEpochs;
+        Time m_trackTimeout;
+        MotionPredictor m_predictor;
+        ClusteringResult m_lastResult;
+        std::map<uint32_t, int> m_lastLabels; // label of each vehicle at the last clustering
+        double m_maxDeviation;
+        bool m_membershipChanged;
+        uint32_t m_predictedEpochs;
+        uint32_t m_clusteringRuns;
+        uint32_t m_totalPredictedEpochs;
+        std::vector<float> m_sentCenters;     // centers of the last update sent
+        std::vector<float> m_sentVelocities;  // and their velX, velY
+        Time m_sentTime;
+        uint32_t m_updatesSent;
+
+        // Downlink broadcast of every epoch's assignments, off when the port is 0
+        uint16_t m_downlinkPort;
+        Ptr<Socket> m_downlinkSocket;
+        uint64_t m_downlinkFrames;
+        uint64_t m_downlinkBytes;
 
 };
+
+// Copies the cluster centers into the matrix SendClusters serializes
+cv::Mat CentersToMat(const ClusteringResult& result){
+    cv::Mat centers(result.numClusters, result.dims, CV_32F);
+    std::copy(result.centers.begin(), result.centers.end(), centers.begin<float>());
+    return centers;
+}
+
 void CAMServer::SetSwitch(Ipv4Address switchAddr, uint16_t port) {
     m_switchIp = switchAddr;
     m_switchPort = port;
@@ -83,10 +181,19 @@ void CAMServer::SendClusters(cv::Mat centers) {
     Ptr<Packet> packet = Create<Packet>(buffer.data(), buffer.size());
 
     // Send the packet to the connected OpenFlow switch
-    TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
-    Ptr<Socket> socket = Socket::CreateSocket(GetNode(), tid);
-    socket->Connect(InetSocketAddress(m_switchIp, m_switchPort));
-    socket->Send(packet);
+    if (!m_switchSocket) {
+        TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+        m_switchSocket = Socket::CreateSocket(GetNode(), tid);
+        m_switchSocket->Connect(InetSocketAddress(m_switchIp, m_switchPort));
+    }
+    m_switchSocket->Send(packet);
+}
+
+void CAMServer::CloseSwitchSocket() {
+    if (m_switchSocket) {
+        m_switchSocket->Close();
+        m_switchSocket = 0;
+    }
 }
 
 
@@ -104,28 +211,59 @@ public:
 
     void SetRemote(Ptr<Socket> socket);
     void SetRemote(Ipv4Address ip, uint16_t port);
+    // Sends the CAMs as CAM_PROTOCOL frames over the 802.11p device to the
+    // RSU's MAC address, so the vehicle needs no IP stack. The downlink, if
+    // enabled, is received on the device too.
+    void SetRemote(Ptr<NetDevice> device, Address rsuAddress);
     void SetInterval(Time interval);
+    void SetLane(uint32_t lane);
+    void SetDownlinkPort(uint16_t port);
+    // Id sent in the CAMs, the node id unless set. Lets several nodes (one
+    // per MPI rank the vehicle drives through) stand for the same vehicle.
+    void SetVehicleId(uint32_t id);
+    uint32_t GetVehicleId() const;
+    // Cluster from the RSU's last downlink broadcast, -1 before the first one
+    int32_t GetCluster() const;
+    const ClusterBroadcast& GetLastBroadcast() const;
 
 private:
     virtual void StartApplication();
     virtual void StopApplication();
 
     void SendCAM();
+    void HandleDownlink(Ptr<Socket> socket);
 
     
 
     Ptr<Socket> m_socket;
     Ipv4Address m_remoteAddress;
     uint16_t m_remotePort;
+    Ptr<NetDevice> m_device;
+    Address m_remoteMac;
     Time m_interval;
     EventId m_sendEvent;
+    uint32_t m_lane;
+    uint32_t m_vehicleId;
+    // Speed and time of the previous CAM, for the acceleration
+    double m_lastSpeed;
+    Time m_lastSent;
+    // Downlink cluster assignments
+    uint16_t m_downlinkPort;
+    Ptr<Socket> m_downlinkSocket;
+    int32_t m_cluster;
+    ClusterBroadcast m_lastBroadcast;
 };
 
 CAMClient::CAMClient()
     : m_socket(0),
       m_remoteAddress(Ipv4Address::GetAny()),
       m_remotePort(0),
-      m_interval(Seconds(1.0))
+      m_interval(Seconds(1.0)),
+      m_lane(0),
+      m_vehicleId(std::numeric_limits<uint32_t>::max()),
+      m_lastSpeed(-1.0),
+      m_downlinkPort(0),
+      m_cluster(-1)
 {
     
 }
@@ -136,6 +274,81 @@ CAMServer::CAMServer(){
     m_socket = 0;
     m_localIp = Ipv4Address::GetAny();
     m_localPort = 0;
+    m_engine = std::make_shared<KMeansEngine>(4);
+    m_epochInterval = Seconds(0);
+    m_epoch = 0;
+    m_deadline = Seconds(0);
+    m_wallClockDeadline = false;
+    m_workUnitCost = NanoSeconds(10);
+    m_lastLatency = Seconds(0);
+    m_predictionTolerance = 0.0;
+    m_maxPredictedEpochs = 10;
+    m_trackTimeout = Seconds(3);
+    m_maxDeviation = 0.0;
+    m_membershipChanged = false;
+    m_predictedEpochs = 0;
+    m_clusteringRuns = 0;
+    m_totalPredictedEpochs = 0;
+    m_sentTime = Seconds(0);
+    m_updatesSent = 0;
+    m_downlinkPort = 0;
+    m_downlinkFrames = 0;
+    m_downlinkBytes = 0;
+}
+
+void CAMServer::SetDownlink(uint16_t port){
+    m_downlinkPort = port;
+}
+
+void CAMServer::SetEpochInterval(Time interval){
+    m_epochInterval = interval;
+}
+
+void CAMServer::SetClusteringDeadline(Time deadline, bool wallClock){
+    m_deadline = deadline;
+    m_wallClockDeadline = wallClock;
+}
+
+void CAMServer::SetPrediction(double tolerance, uint32_t maxPredictedEpochs){
+    m_predictionTolerance = tolerance;
+    m_maxPredictedEpochs = maxPredictedEpochs;
+}
+
+ClusteringResult CAMServer::RunClustering(const std::vector<CAMData>& cams){
+    ClusteringBudget budget;
+    if(m_deadline.IsStrictlyPositive()){
+        if(m_wallClockDeadline){
+            budget.deadline = std::chrono::steady_clock::now()
+                              + std::chrono::nanoseconds(m_deadline.GetNanoSeconds());
+        } else {
+            budget.workUnits = std::max<int64_t>(1, m_deadline.GetNanoSeconds() / m_workUnitCost.GetNanoSeconds());
+        }
+    }
+    m_engine->SetBudget(budget);
+
+    auto start = std::chrono::steady_clock::now();
+    ClusteringResult result = ClusterCAMData(cams, *m_engine);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Without a deadline the result goes out right away, as it always did
+    m_lastLatency = Seconds(0);
+    if(m_deadline.IsStrictlyPositive()){
+        m_lastLatency = m_wallClockDeadline
+                        ? NanoSeconds(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())
+                        : m_workUnitCost * result.workUnits;
+    }
+
+    if(!result.converged && std::isinf(result.inertiaGap)){
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " clustering hit its deadline before the first center update");
+    }else if(!result.converged){
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " clustering hit its deadline, estimated inertia gap "
+                      << result.inertiaGap * 100 << "%");
+    }
+    return result;
+}
+
+void CAMServer::SetClusteringEngine(std::shared_ptr<ClusteringEngine> engine){
+    m_engine = engine;
 }
 
 CAMServer::~CAMServer(){
@@ -152,7 +365,18 @@ void CAMServer::SetLocal(Ipv4Address ip, uint16_t port){
     m_localPort = port;
 }
 
+void CAMServer::SetLocal(Ptr<NetDevice> device){
+    m_localDevice = device;
+}
+
 void CAMServer::StartApplication(){
+    if(!m_socket && m_localDevice){
+        PacketSocketAddress local;
+        local.SetSingleDevice(m_localDevice->GetIfIndex());
+        local.SetProtocol(CAM_PROTOCOL);
+        m_socket = Socket::CreateSocket(GetNode(), TypeId::LookupByName("ns3::PacketSocketFactory"));
+        m_socket->Bind(local);
+    }
     if(!m_socket){
         TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
         m_socket = Socket::CreateSocket(GetNode(), tid);
@@ -160,6 +384,191 @@ void CAMServer::StartApplication(){
     }
 
     m_socket->SetRecvCallback(MakeCallback(&CAMServer::HandleRead, this));
+
+    if(m_epochInterval.IsStrictlyPositive()){
+        m_epochEvent = Simulator::Schedule(m_epochInterval, &CAMServer::RunEpoch, this);
+    }
+}
+
+void CAMServer::PublishClusters(const std::vector<CAMData>& cams, const ClusteringResult& result){
+    if(!globalClusterFeed.IsOpen()){
+        return;
+    }
+    ClusterFeedRecord record;
+    record.epoch = m_epoch;
+    record.rsuId = GetNode()->GetId();
+    record.simTime = Simulator::Now().GetSeconds();
+    record.numClusters = result.numClusters;
+    record.dims = result.dims;
+    record.centers = result.centers;
+    record.assignments.reserve(cams.size());
+    for(size_t i = 0; i < cams.size(); ++i){
+        record.assignments.emplace_back(cams[i].id, result.labels[i]);
+    }
+    if(!globalClusterFeed.Publish(record)){
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " epoch " << m_epoch << ": " << result.numClusters
+                      << " centers do not fit into a cluster feed slot, record dropped ("
+                      << globalClusterFeed.GetRejected() << " so far)");
+    }
+}
+
+void CAMServer::AssignAddresses(const std::vector<CAMData>& cams, const ClusteringResult& result){
+    if(!globalClusterAddressing.IsEnabled()){
+        return;
+    }
+    std::vector<uint32_t> vehicleIds;
+    for(const auto& cam : cams){
+        vehicleIds.push_back(cam.id);
+    }
+    globalClusterAddressing.AssignClusters(GetNode()->GetId(), vehicleIds, result.labels);
+}
+
+void CAMServer::BroadcastClusters(const std::vector<CAMData>& cams, const ClusteringResult& result){
+    if(m_downlinkPort == 0){
+        return;
+    }
+    ClusterBroadcast message;
+    message.rsuId = GetNode()->GetId();
+    message.epoch = m_epoch;
+    message.numClusters = result.numClusters;
+    message.dims = result.dims;
+    message.centers = result.centers;
+    message.assignments.reserve(cams.size());
+    for(size_t i = 0; i < cams.size(); ++i){
+        message.assignments.emplace_back(cams[i].id, result.labels[i]);
+    }
+    std::vector<std::vector<uint8_t>> frames = EncodeClusterBroadcast(message);
+    if(frames.empty()){
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " epoch " << m_epoch << ": " << cams.size()
+                      << " assignments do not fit in 255 downlink frames, nothing broadcast");
+        return;
+    }
+    Simulator::Schedule(m_lastLatency, &CAMServer::SendDownlink, this, frames);
+}
+
+void CAMServer::SendDownlink(std::vector<std::vector<uint8_t>> frames){
+    if(m_localDevice){
+        // MAC broadcast on the device, one frame per 802.11p frame
+        PacketSocketAddress broadcast;
+        broadcast.SetSingleDevice(m_localDevice->GetIfIndex());
+        broadcast.SetPhysicalAddress(m_localDevice->GetBroadcast());
+        broadcast.SetProtocol(CLUSTER_DOWNLINK_PROTOCOL);
+        if(!m_downlinkSocket){
+            m_downlinkSocket = Socket::CreateSocket(GetNode(), TypeId::LookupByName("ns3::PacketSocketFactory"));
+            m_downlinkSocket->Bind(broadcast);
+            // Send only, the broadcasts of neighbouring RSUs must not queue up
+            m_downlinkSocket->ShutdownRecv();
+        }
+        for(const auto& frame : frames){
+            m_downlinkSocket->SendTo(Create<Packet>(frame.data(), frame.size()), 0, broadcast);
+            ++m_downlinkFrames;
+            m_downlinkBytes += frame.size();
+        }
+        return;
+    }
+    // Subnet broadcast on the 802.11p interface, one frame per datagram
+    Ipv4InterfaceAddress wifiAddress = GetNode()->GetObject<Ipv4>()->GetAddress(1, 0);
+    if(!m_downlinkSocket){
+        m_downlinkSocket = Socket::CreateSocket(GetNode(), TypeId::LookupByName("ns3::UdpSocketFactory"));
+        m_downlinkSocket->SetAllowBroadcast(true);
+        m_downlinkSocket->Bind();
+    }
+    for(const auto& frame : frames){
+        Ptr<Packet> packet = Create<Packet>(frame.data(), frame.size());
+        m_downlinkSocket->SendTo(packet, 0, InetSocketAddress(wifiAddress.GetBroadcast(), m_downlinkPort));
+        ++m_downlinkFrames;
+        m_downlinkBytes += frame.size();
+    }
+}
+
+// Sends the centers of an epoch after its compute latency. With prediction on,
+// every center row is followed by the center's velX and velY.
+void CAMServer::SendClusterUpdate(const std::vector<CAMData>& cams, const ClusteringResult& result){
+    cv::Mat centers = CentersToMat(result);
+    if(m_predictionTolerance > 0){
+        m_sentCenters = result.centers;
+        m_sentVelocities = ClusterVelocities(m_predictor, cams, result);
+        m_sentTime = Simulator::Now();
+        cv::Mat velocities(result.numClusters, 2, CV_32F);
+        std::copy(m_sentVelocities.begin(), m_sentVelocities.end(), velocities.begin<float>());
+        cv::hconcat(centers, velocities, centers);
+    }
+    ++m_updatesSent;
+    Simulator::Schedule(m_lastLatency, &CAMServer::SendClusters, this, centers);
+}
+
+bool CAMServer::CanPredict(const std::vector<CAMData>& cams) const{
+    if(m_predictionTolerance <= 0 || m_lastLabels.empty() || m_membershipChanged
+       || m_maxDeviation > m_predictionTolerance || m_predictedEpochs >= m_maxPredictedEpochs){
+        return false;
+    }
+    for(const auto& cam : cams){
+        if(m_lastLabels.find(cam.id) == m_lastLabels.end()){
+            return false;
+        }
+    }
+    return cams.size() == m_lastLabels.size();
+}
+
+void CAMServer::RunEpoch(){
+    std::vector<CAMData> cams;
+    if(m_predictionTolerance > 0){
+        // Vehicles that went quiet have left the RSU
+        double now = Simulator::Now().GetSeconds();
+        if(m_predictor.Forget(now - m_trackTimeout.GetSeconds()) > 0){
+            m_membershipChanged = true;
+        }
+        for(const auto& vehicle : m_predictor.GetTracks()){
+            cams.push_back(m_predictor.Predict(vehicle.first, now));
+        }
+    } else {
+        for(const auto& vehicle : m_epochCAMs){
+            cams.push_back(vehicle.second);
+        }
+    }
+    m_epochCAMs.clear();
+
+    if(!cams.empty() && CanPredict(cams)){
+        std::vector<int> labels;
+        for(const auto& cam : cams){
+            labels.push_back(m_lastLabels[cam.id]);
+        }
+        ClusteringResult result = PredictClusters(m_lastResult, cams, labels);
+        // Moving the centers costs next to nothing, the update goes out now
+        m_lastLatency = Seconds(0);
+        PublishClusters(cams, result);
+        globalClusterIndex.Update(cams, result, GetNode()->GetId(), m_epoch);
+        BroadcastClusters(cams, result);
+        double drift = CenterDrift(result, m_sentCenters, m_sentVelocities, (Simulator::Now() - m_sentTime).GetSeconds());
+        if(drift > m_predictionTolerance){
+            SendClusterUpdate(cams, result);
+        }
+        ++m_predictedEpochs;
+        ++m_totalPredictedEpochs;
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " epoch " << m_epoch << ": " << result.numClusters
+                      << " clusters predicted for " << cams.size() << " vehicles");
+    } else if(!cams.empty()){
+        ClusteringResult result = RunClustering(cams);
+        PublishClusters(cams, result);
+        AssignAddresses(cams, result);
+        globalClusterIndex.Update(cams, result, GetNode()->GetId(), m_epoch);
+        BroadcastClusters(cams, result);
+        ++m_clusteringRuns;
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " epoch " << m_epoch << ": " << result.numClusters
+                      << " clusters from " << cams.size() << " vehicles, sent after " << m_lastLatency.As(Time::MS));
+        SendClusterUpdate(cams, result);
+
+        m_lastResult = result;
+        m_lastLabels.clear();
+        for(size_t i = 0; i < cams.size(); ++i){
+            m_lastLabels[cams[i].id] = result.labels[i];
+        }
+        m_maxDeviation = 0.0;
+        m_membershipChanged = false;
+        m_predictedEpochs = 0;
+    }
+    ++m_epoch;
+    m_epochEvent = Simulator::Schedule(m_epochInterval, &CAMServer::RunEpoch, this);
 }
 
 void CAMServer::SetNumRSUs(uint32_t numRSUs){
@@ -168,7 +577,17 @@ void CAMServer::SetNumRSUs(uint32_t numRSUs){
 
 void CAMServer::StopApplication(){
     
-    
+    Simulator::Cancel(m_epochEvent);
+    if(m_epochInterval.IsStrictlyPositive()){
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " ran " << m_clusteringRuns << " clusterings and predicted "
+                      << m_totalPredictedEpochs << " epochs, sending " << m_updatesSent << " cluster updates");
+    }
+    if(m_downlinkSocket){
+        NS_LOG_UNCOND("RSU " << GetNode()->GetId() << " broadcast " << m_downlinkFrames << " downlink frames ("
+                      << m_downlinkBytes << " bytes)");
+        m_downlinkSocket->Close();
+    }
+
     if(m_socket){
         m_socket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket> >());
         m_socket->Close();
@@ -184,10 +603,16 @@ void CAMServer::StopApplication(){
         NS_LOG_UNCOND("RSU Application received all CAM messages");
         NS_LOG_UNCOND("RSU Application performing clustering");
         centers = PerformClustering();
+        if(m_predictionTolerance > 0 && centers.rows > 0){
+            // Same layout as the epoch updates, with centers that stay put
+            cv::hconcat(centers, cv::Mat::zeros(centers.rows, 2, CV_32F), centers);
+        }
         NS_LOG_UNCOND("Sending Clusters to OpenFlow Switch");
-        SendClusters(centers);
+        Simulator::Schedule(m_lastLatency, &CAMServer::SendClusters, this, centers);
         NS_LOG_UNCOND("Sent cluster information to openflow switch");
     }
+    // After the sends still waiting for their compute latency
+    Simulator::Schedule(m_lastLatency, &CAMServer::CloseSwitchSocket, this);
 }   
 
 
@@ -205,65 +630,81 @@ void CAMServer::HandleRead(Ptr<Socket> socket){
     Ptr<Packet> packet;
     Address from;
     while(packet = socket->RecvFrom(from)){
-        CAMData data;
-        packet->CopyData(reinterpret_cast<uint8_t *>(&data), sizeof(data));
-        std::cout << "Received CAM message with position (" << data.posX << ", " << data.posY << ") and speed " << data.speed
-                  << " from " << "vehicle " << data.id << std::endl;
-        m_camData.push_back(data);
+        uint8_t buffer[CAMWireSchema::WIRE_BYTES];
+        uint32_t length = packet->CopyData(buffer, sizeof(buffer));
+        if(globalCAMTrace.IsOpen()){
+            globalCAMTrace.Write(Simulator::Now().GetSeconds(), GetNode()->GetId(), buffer, length);
+        }
+        ReceiveCAM(buffer, length);
     }
 }
 
-cv::Mat CAMServer::PerformClustering(){
-    
-    NS_LOG_UNCOND("RSU Application clustering started");
-    
-    int numClusters = 4;
-    int numDataPoints = 0;
+void CAMServer::ReceiveCAM(const uint8_t* payload, uint32_t length){
+    CAMData data = {};
+    CAMWireSchema::Decode(payload, length, data);
+    std::cout << "Received CAM message with position (" << data.posX << ", " << data.posY << ") and speed " << data.speed
+              << " from " << "vehicle " << data.id << std::endl;
+    m_camData.push_back(data);
+    m_epochCAMs[data.id] = data;
+    globalClusterIndex.Observe(data, GetNode()->GetId());
+
+    if(m_predictionTolerance > 0){
+        if(m_lastLabels.find(data.id) == m_lastLabels.end()){
+            m_membershipChanged = true;
+        }
+        m_maxDeviation = std::max(m_maxDeviation, m_predictor.Observe(data, Simulator::Now().GetSeconds()));
+    }
+}
 
-    for(const auto& clusterData: globalCAMData){
-        numDataPoints += clusterData.size();
+// Runs the clustering on a recorded CAM trace without building the network.
+// The CAMs are grouped per RSU in the same way the RSUs hand them over to
+// globalCAMData at the end of a live run.
+cv::Mat ReplayCAMTrace(const std::string& path, std::shared_ptr<ClusteringEngine> engine){
+    CAMTraceReader reader;
+    if(!reader.Open(path)){
+        NS_FATAL_ERROR("Cannot read CAM trace " << path);
     }
-    
-    
-    cv::Mat dataPoints(numDataPoints, 4, CV_32F);
-    int row = 0;
-    for (const auto& clusterData : globalCAMData) {
-        for (const auto& point : clusterData) {
-            dataPoints.at<float>(row, 0) = point.posX;
-            dataPoints.at<float>(row, 1) = point.posY;
-            dataPoints.at<float>(row, 2) = point.speed;
-            dataPoints.at<float>(row, 3) = point.id;
-            ++row;
-        }
+
+    std::map<uint32_t, std::vector<CAMData>> camsPerRSU;
+    CAMTraceRecord record;
+    size_t numRecords = 0;
+    while(reader.Next(record)){
+        CAMData data = {};
+        CAMWireSchema::Decode(record.payload.data(), record.payload.size(), data);
+        camsPerRSU[record.rsuId].push_back(data);
+        ++numRecords;
     }
+    NS_LOG_UNCOND("Replaying " << numRecords << " CAMs from " << camsPerRSU.size() << " RSUs");
 
-    // take the first 3 rows of every dataPoint sample
-    
+    globalCAMData.clear();
+    for(const auto& rsu : camsPerRSU){
+        globalCAMData.push_back(rsu.second);
+    }
+
+    // PerformClustering runs inside an RSU application, give it a bare node
+    Ptr<Node> node = CreateObject<Node>();
+    Ptr<CAMServer> server = CreateObject<CAMServer>();
+    node->AddApplication(server);
+    server->SetClusteringEngine(engine);
+    return server->PerformClustering();
+}
 
-     
+cv::Mat CAMServer::PerformClustering(){
     
+    NS_LOG_UNCOND("RSU Application clustering started with the " << m_engine->GetName() << " engine");
 
-        // Perform k-means clustering
-    cv::Mat labels;
-    cv::Mat centers;
-    cv::kmeans(dataPoints, 
-    numClusters, 
-    labels, 
-    cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 10, 1.0), 
-    3, 
-    cv::KMEANS_PP_CENTERS, centers);
-
-       // Process results
-    std::vector<std::vector<CAMData>> clusteredData(numClusters);
-    for (int i = 0; i < numDataPoints; ++i) {
-        int clusterIdx = labels.at<int>(i);
-        CAMData point;
-        point.posX = dataPoints.at<float>(i, 0);
-        point.posY = dataPoints.at<float>(i, 1);
-        point.speed = dataPoints.at<float>(i, 2);
-        point.id = GetNode()->GetId();
-        clusteredData[clusterIdx].push_back(point);
+    std::vector<CAMData> dataPoints;
+    for (const auto& clusterData : globalCAMData) {
+        dataPoints.insert(dataPoints.end(), clusterData.begin(), clusterData.end());
     }
+
+    ClusteringResult result = RunClustering(dataPoints);
+    PublishClusters(dataPoints, result);
+    AssignAddresses(dataPoints, result);
+    globalClusterIndex.Update(dataPoints, result, GetNode()->GetId(), m_epoch);
+
+    // Process results
+    std::vector<std::vector<CAMData>> clusteredData = GroupByCluster(dataPoints, result);
     
     NS_LOG_UNCOND("RSU Application clustering completed");
 
@@ -271,38 +712,36 @@ cv::Mat CAMServer::PerformClustering(){
     // Replace globalCAMData with clusteredData
     globalCAMData = clusteredData;
 
-    // Print cl uster centers
-    std::cout << "Cluster centers:" << std::endl;
-    for (int i = 0; i < numClusters; ++i) {
-        std::cout << "Cluster " << i + 1 << ": ("
-                  << centers.at<float>(i, 0) << ", "
-                  << centers.at<float>(i, 1) << ", "
-                  << centers.at<float>(i, 2) << ") with node ID: " 
-                  << centers.at<float>(i, 3) << std::endl;
-        // print the node ID of the centroid
+    // Print cluster centers
+    std::cout << "Cluster centers (" << DefaultCAMSchema::Header() << "):" << std::endl;
+    for (int i = 0; i < result.numClusters; ++i) {
+        std::cout << "Cluster " << i + 1 << ": (";
+        DefaultCAMSchema::WriteRow(std::cout, &result.centers[size_t(i) * result.dims]);
+        std::cout << ")" << std::endl;
     }
 
     // Save every cluster to a csv file
-    for (int i = 0; i < numClusters; ++i) {
-        std::ofstream file;
-        std::string fileName = "cluster" + std::to_string(i + 1) + ".csv";
-        file.open(fileName);
-        for (const auto& point : clusteredData[i]) {
-            file << point.posX << "," << point.posY << "," << point.speed << "," << point.id << std::endl;
-        }
-        file.close();
-    }
-
-    return centers;
-    
-    
+    SaveClusterCSVs(clusteredData, globalClusterCSVPrefix);
 
+    return CentersToMat(result);
 }
 
 std::vector<CAMData> CAMServer::GetCAMData(){
     return m_camData;
 }
 
+// Cluster of the vehicle of every CAM in GetCAMData(), as currently in the
+// cluster index; unclustered vehicles get SIZE_MAX
+std::vector<size_t> CAMServer::AssignVehiclesToClusters(){
+    std::vector<size_t> clusters;
+    clusters.reserve(m_camData.size());
+    for(const auto& cam : m_camData){
+        const ClusterMembership& entry = globalClusterIndex.Lookup(cam.id);
+        clusters.push_back(entry.IsClustered() ? size_t(entry.cluster) : SIZE_MAX);
+    }
+    return clusters;
+}
+
 
 
 CAMClient::~CAMClient()
@@ -320,22 +759,115 @@ void CAMClient::SetRemote(Ipv4Address ip, uint16_t port)
     m_remotePort = port;
 }
 
+void CAMClient::SetRemote(Ptr<NetDevice> device, Address rsuAddress)
+{
+    m_device = device;
+    m_remoteMac = rsuAddress;
+}
+
 void CAMClient::SetInterval(Time interval)
 {
     m_interval = interval;
 }
 
-void CAMClient::StartApplication()
+void CAMClient::SetLane(uint32_t lane)
 {
-    if (!m_socket)
+    m_lane = lane;
+}
+
+void CAMClient::SetDownlinkPort(uint16_t port)
+{
+    m_downlinkPort = port;
+}
+
+void CAMClient::SetVehicleId(uint32_t id)
+{
+    m_vehicleId = id;
+}
+
+uint32_t CAMClient::GetVehicleId() const
+{
+    return m_vehicleId == std::numeric_limits<uint32_t>::max() ? GetNode()->GetId() : m_vehicleId;
+}
+
+int32_t CAMClient::GetCluster() const
+{
+    return m_cluster;
+}
+
+const ClusterBroadcast& CAMClient::GetLastBroadcast() const
+{
+    return m_lastBroadcast;
+}
+
+void CAMClient::HandleDownlink(Ptr<Socket> socket)
+{
+    Ptr<Packet> packet;
+    Address from;
+    while ((packet = socket->RecvFrom(from)))
     {
-        TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
-        m_socket = Socket::CreateSocket(GetNode(), tid);
+        std::vector<uint8_t> buffer(packet->GetSize());
+        packet->CopyData(buffer.data(), buffer.size());
+        ClusterBroadcast message;
+        if (!DecodeClusterBroadcast(buffer.data(), buffer.size(), message))
+        {
+            continue;
+        }
+        // Frames of other RSUs or covering other vehicles are ignored
+        int32_t cluster = message.FindCluster(GetVehicleId());
+        if (cluster >= 0)
+        {
+            m_cluster = cluster;
+            m_lastBroadcast = std::move(message);
+        }
     }
+}
 
-    m_socket->Connect(InetSocketAddress(m_remoteAddress, m_remotePort));
+void CAMClient::StartApplication()
+{
+    if (m_device)
+    {
+        if (!m_socket)
+        {
+            PacketSocketAddress remote;
+            remote.SetSingleDevice(m_device->GetIfIndex());
+            remote.SetProtocol(CAM_PROTOCOL);
+            m_socket = Socket::CreateSocket(GetNode(), TypeId::LookupByName("ns3::PacketSocketFactory"));
+            m_socket->Bind(remote);
+            m_socket->ShutdownRecv();
+            remote.SetPhysicalAddress(m_remoteMac);
+            m_socket->Connect(remote);
+        }
+    }
+    else
+    {
+        if (!m_socket)
+        {
+            TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
+            m_socket = Socket::CreateSocket(GetNode(), tid);
+        }
+        m_socket->Connect(InetSocketAddress(m_remoteAddress, m_remotePort));
+    }
     m_sendEvent = Simulator::Schedule(Seconds(0.0), &CAMClient::SendCAM, this);
 
+    if (m_downlinkPort && !m_downlinkSocket)
+    {
+        if (m_device)
+        {
+            PacketSocketAddress local;
+            local.SetSingleDevice(m_device->GetIfIndex());
+            local.SetProtocol(CLUSTER_DOWNLINK_PROTOCOL);
+            m_downlinkSocket = Socket::CreateSocket(GetNode(), TypeId::LookupByName("ns3::PacketSocketFactory"));
+            m_downlinkSocket->Bind(local);
+        }
+        else
+        {
+            m_downlinkSocket = Socket::CreateSocket(GetNode(), TypeId::LookupByName("ns3::UdpSocketFactory"));
+            m_downlinkSocket->Bind(InetSocketAddress(Ipv4Address::GetAny(), m_downlinkPort));
+        }
+        m_downlinkSocket->SetRecvCallback(MakeCallback(&CAMClient::HandleDownlink, this));
+    }
+
 }
 void CAMClient::StopApplication()
 {
@@ -345,6 +877,11 @@ void CAMClient::StopApplication()
     {
         m_socket->Close();
     }
+    if (m_downlinkSocket)
+    {
+        m_downlinkSocket->SetRecvCallback(MakeNullCallback<void, Ptr<Socket>>());
+        m_downlinkSocket->Close();
+    }
 }
 
 void CAMClient::SendCAM()
@@ -356,23 +893,39 @@ void CAMClient::SendCAM()
 
 
 
-    CAMData data;
+    CAMData data = {};
     data.posX = position.x;
     data.posY = position.y;
     data.speed = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
-    data.id  = GetNode()->GetId();
+    data.id  = GetVehicleId();
+    data.heading = std::atan2(velocity.y, velocity.x) * 180.0 / M_PI;
+    if (m_lastSpeed >= 0 && Simulator::Now() > m_lastSent) {
+        data.acceleration = (data.speed - m_lastSpeed) / (Simulator::Now() - m_lastSent).GetSeconds();
+    }
+    data.lane = m_lane;
+    m_lastSpeed = data.speed;
+    m_lastSent = Simulator::Now();
     // Serialize the CAM Data into a byte array
 
-    uint8_t buffer[sizeof(CAMData)];
-    memcpy(buffer, &data, sizeof(CAMData));
-    Ptr<Packet> packet = Create<Packet>(buffer, sizeof(CAMData));   
+    uint8_t buffer[CAMWireSchema::WIRE_BYTES];
+    CAMWireSchema::Encode(data, buffer);
+    Ptr<Packet> packet = Create<Packet>(buffer, sizeof(buffer));   
 
     
 
 
     m_socket->Send(packet);
     std::cout << "Sent CAM message with position (" << data.posX << ", " << data.posY << "), ID" << data.id <<
-    " and speed " << data.speed << " to " << m_remoteAddress << " at " << Simulator::Now() << std::endl;
+    " and speed " << data.speed << " to ";
+    if (m_device)
+    {
+        std::cout << Mac48Address::ConvertFrom(m_remoteMac);
+    }
+    else
+    {
+        std::cout << m_remoteAddress;
+    }
+    std::cout << " at " << Simulator::Now() << std::endl;
 
     // Schedule the next CAM message transmission
     m_sendEvent = Simulator::Schedule(m_interval, &CAMClient::SendCAM, this);
@@ -0,0 +1,79 @@
+#ifndef CAM_CLUSTERING_H
+#define CAM_CLUSTERING_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "kmeans.h"
+#include "clustering_engine.h"
+#include "cam_schema.h"
+
+// Clustering core shared by the RSU application and the offline tools.
+// Nothing in here depends on ns-3.
+
+// Number of features every CAM contributes to the clustering
+static const int CAM_FEATURES = DefaultCAMSchema::DIMS;
+
+// Packs the CAMs into a row major numPoints x Schema::DIMS matrix
+template <typename Schema = DefaultCAMSchema>
+inline std::vector<float> PackCAMData(const std::vector<CAMData>& cams) {
+    return Schema::Pack(cams);
+}
+
+// k-means over the schema's features of the given CAMs. The defaults match
+// the criteria the RSU always used: 3 attempts of at most 10 iterations.
+template <typename Schema = DefaultCAMSchema>
+inline ClusteringResult ClusterCAMData(const std::vector<CAMData>& cams, int numClusters,
+                                       const KMeansOptions& options = KMeansOptions(),
+                                       KMeansStats* stats = nullptr) {
+    return KMeans(Schema::Pack(cams), Schema::DIMS, numClusters, options, stats);
+}
+
+// Clusters the CAMs with the given engine
+template <typename Schema = DefaultCAMSchema>
+inline ClusteringResult ClusterCAMData(const std::vector<CAMData>& cams, ClusteringEngine& engine) {
+    return engine.Cluster(Schema::Pack(cams), Schema::DIMS);
+}
+
+// Splits the CAMs by cluster label, unclustered (noise) points are dropped
+inline std::vector<std::vector<CAMData>> GroupByCluster(const std::vector<CAMData>& cams,
+                                                        const ClusteringResult& result) {
+    std::vector<std::vector<CAMData>> clusteredData(result.numClusters);
+    for (size_t i = 0; i < cams.size(); ++i) {
+        if (result.labels[i] >= 0) {
+            clusteredData[result.labels[i]].push_back(cams[i]);
+        }
+    }
+    return clusteredData;
+}
+
+// Writes one cluster<N>.csv file per cluster, one CAMCSVSchema row per CAM
+inline void SaveClusterCSVs(const std::vector<std::vector<CAMData>>& clusteredData,
+                            const std::string& prefix = "cluster") {
+    for (size_t i = 0; i < clusteredData.size(); ++i) {
+        std::ofstream file(prefix + std::to_string(i + 1) + ".csv");
+        for (const auto& point : clusteredData[i]) {
+            CAMCSVSchema::WriteCAM(file, point);
+            file << std::endl;
+        }
+    }
+}
+
+// Reads a file in the cluster<N>.csv format back into CAMs
+inline bool ReadClusterCSV(const std::string& path, std::vector<CAMData>& cams) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        CAMData point = {};
+        if (CAMCSVSchema::ReadCAM(line, point)) {
+            cams.push_back(point);
+        }
+    }
+    return true;
+}
+
+#endif // CAM_CLUSTERING_H
@@ -0,0 +1,231 @@
+#ifndef CAM_SCHEMA_H
+#define CAM_SCHEMA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <ratio>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "kmeans.h"
+
+// CAM contents and the compile-time feature schema used to cluster them.
+//
+// A feature names one CAM field and the type it is encoded and written as.
+// A CAMSchema lists the features the
+// clustering sees, each optionally scaled (Scaled<Speed, std::ratio<10>>
+// weighs one m/s like ten metres). The schema generates the packing of CAMs
+// into feature rows and the distance, with the dimension fixed at compile
+// time and the per-feature loops unrolled, as well as the byte encoding of
+// CAMWireSchema on the air and the CSV rows of CAMCSVSchema. Adding a
+// feature takes a CAMData member, a feature struct, its place in the
+// schemas and the code in CAMClient::SendCAM that measures it. Nothing in
+// here depends on ns-3.
+
+struct CAMData {
+    double posX;
+    double posY;
+    double speed;
+    uint32_t id;
+    double heading;       // degrees counter-clockwise from the x axis
+    double acceleration;  // m/s^2 along the direction of travel
+    uint32_t lane;        // lane index in the direction of travel
+};
+
+struct PosX {
+    using Type = double;
+    static constexpr const char* NAME = "posX";
+    static constexpr double SCALE = 1.0;
+    static double Get(const CAMData& cam) { return cam.posX; }
+    static void Set(CAMData& cam, double value) { cam.posX = value; }
+};
+
+struct PosY {
+    using Type = double;
+    static constexpr const char* NAME = "posY";
+    static constexpr double SCALE = 1.0;
+    static double Get(const CAMData& cam) { return cam.posY; }
+    static void Set(CAMData& cam, double value) { cam.posY = value; }
+};
+
+struct Speed {
+    using Type = double;
+    static constexpr const char* NAME = "speed";
+    static constexpr double SCALE = 1.0;
+    static double Get(const CAMData& cam) { return cam.speed; }
+    static void Set(CAMData& cam, double value) { cam.speed = value; }
+};
+
+// Compared as plain numbers, so 359 and 1 degrees are far apart
+struct Heading {
+    using Type = double;
+    static constexpr const char* NAME = "heading";
+    static constexpr double SCALE = 1.0;
+    static double Get(const CAMData& cam) { return cam.heading; }
+    static void Set(CAMData& cam, double value) { cam.heading = value; }
+};
+
+struct Acceleration {
+    using Type = double;
+    static constexpr const char* NAME = "acceleration";
+    static constexpr double SCALE = 1.0;
+    static double Get(const CAMData& cam) { return cam.acceleration; }
+    static void Set(CAMData& cam, double value) { cam.acceleration = value; }
+};
+
+struct Lane {
+    using Type = uint32_t;
+    static constexpr const char* NAME = "lane";
+    static constexpr double SCALE = 1.0;
+    static double Get(const CAMData& cam) { return cam.lane; }
+    static void Set(CAMData& cam, double value) { cam.lane = uint32_t(std::max(0.0, value + 0.5)); }
+};
+
+// The original clustering used the vehicle id as a feature
+struct VehicleId {
+    using Type = uint32_t;
+    static constexpr const char* NAME = "id";
+    static constexpr double SCALE = 1.0;
+    static double Get(const CAMData& cam) { return cam.id; }
+    static void Set(CAMData& cam, double value) { cam.id = uint32_t(std::max(0.0, value + 0.5)); }
+};
+
+// Multiplies the feature by Ratio before clustering
+template <typename Feature, typename Ratio>
+struct Scaled : Feature {
+    static constexpr double SCALE = Feature::SCALE * Ratio::num / Ratio::den;
+};
+
+template <typename... Features>
+struct CAMSchema {
+    static constexpr int DIMS = sizeof...(Features);
+    static_assert(DIMS > 0, "A CAM schema needs at least one feature");
+
+    // Writes the scaled features of the CAM to row[0..DIMS)
+    static void Extract(const CAMData& cam, float* row) {
+        ExtractAll(cam, row, std::index_sequence_for<Features...>());
+    }
+
+    // Packs the CAMs into a row major numPoints x DIMS matrix
+    static std::vector<float> Pack(const std::vector<CAMData>& cams) {
+        std::vector<float> points(cams.size() * DIMS);
+        for (size_t i = 0; i < cams.size(); ++i) {
+            Extract(cams[i], points.data() + i * DIMS);
+        }
+        return points;
+    }
+
+    static double SquaredDistance(const float* a, const float* b) {
+        return SquaredDistanceN<DIMS>(a, b, DIMS);
+    }
+
+    // Comma separated feature names
+    static std::string Header() {
+        std::string header;
+        ((header += (header.empty() ? "" : ",") + std::string(Features::NAME)), ...);
+        return header;
+    }
+
+    // Writes a feature row in CAM units, comma separated
+    static void WriteRow(std::ostream& out, const float* row) {
+        WriteAll(out, row, std::index_sequence_for<Features...>());
+    }
+
+    // Size of a CAM encoded with Encode
+    static constexpr size_t WIRE_BYTES = (sizeof(typename Features::Type) + ...);
+
+    // Writes the fields of the schema back to back in host byte order,
+    // without padding, to out[0..WIRE_BYTES)
+    static void Encode(const CAMData& cam, uint8_t* out) {
+        (EncodeField<Features>(cam, out), ...);
+    }
+
+    // Reads the fields written by Encode. A shorter payload sets the leading
+    // fields it holds and leaves the others alone; returns whether all were
+    // present.
+    static bool Decode(const uint8_t* in, size_t length, CAMData& cam) {
+        const uint8_t* end = in + length;
+        return (DecodeField<Features>(in, end, cam) && ...);
+    }
+
+    // Writes the fields of the schema as one comma separated line, without
+    // the newline
+    static void WriteCAM(std::ostream& out, const CAMData& cam) {
+        WriteCAMAll(out, cam, std::index_sequence_for<Features...>());
+    }
+
+    // Parses a line written by WriteCAM; false if a field is missing
+    static bool ReadCAM(const std::string& line, CAMData& cam) {
+        std::istringstream in(line);
+        return ReadCAMAll(in, cam, std::index_sequence_for<Features...>());
+    }
+
+    private:
+        template <size_t... I>
+        static void ExtractAll(const CAMData& cam, float* row, std::index_sequence<I...>) {
+            ((row[I] = Features::Get(cam) * Features::SCALE), ...);
+        }
+
+        template <typename Feature>
+        static void EncodeField(const CAMData& cam, uint8_t*& out) {
+            typename Feature::Type value = typename Feature::Type(Feature::Get(cam));
+            std::memcpy(out, &value, sizeof(value));
+            out += sizeof(value);
+        }
+
+        template <typename Feature>
+        static bool DecodeField(const uint8_t*& in, const uint8_t* end, CAMData& cam) {
+            typename Feature::Type value;
+            if (size_t(end - in) < sizeof(value)) {
+                return false;
+            }
+            std::memcpy(&value, in, sizeof(value));
+            in += sizeof(value);
+            Feature::Set(cam, value);
+            return true;
+        }
+
+        template <typename Feature>
+        static bool ReadField(std::istream& in, bool first, CAMData& cam) {
+            typename Feature::Type value;
+            char comma = ',';
+            if (!first) {
+                in >> comma;
+            }
+            if (comma != ',' || !(in >> value)) {
+                return false;
+            }
+            Feature::Set(cam, value);
+            return true;
+        }
+
+        template <size_t... I>
+        static void WriteAll(std::ostream& out, const float* row, std::index_sequence<I...>) {
+            ((out << (I ? "," : "") << row[I] / Features::SCALE), ...);
+        }
+
+        template <size_t... I>
+        static void WriteCAMAll(std::ostream& out, const CAMData& cam, std::index_sequence<I...>) {
+            ((out << (I ? "," : "") << typename Features::Type(Features::Get(cam))), ...);
+        }
+
+        template <size_t... I>
+        static bool ReadCAMAll(std::istream& in, CAMData& cam, std::index_sequence<I...>) {
+            return (ReadField<Features>(in, I == 0, cam) && ...);
+        }
+};
+
+// Features the RSUs cluster on. The vehicle id is no longer one of them: it
+// only made vehicles with close ids look alike.
+using DefaultCAMSchema = CAMSchema<PosX, PosY, Speed>;
+
+// Fields of a CAM on the air and in CAM traces, in the order of CAMData
+using CAMWireSchema = CAMSchema<PosX, PosY, Speed, VehicleId, Heading, Acceleration, Lane>;
+
+// Columns of the cluster<N>.csv files
+using CAMCSVSchema = CAMSchema<PosX, PosY, Speed, VehicleId>;
+
+#endif // CAM_SCHEMA_H
@@ -0,0 +1,111 @@
+#ifndef CAM_TRACE_H
+#define CAM_TRACE_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Compact binary log of the CAMs received by the RSUs.
+//
+// The file starts with the magic "CAMT" and a format version, followed by one
+// record per received CAM:
+//
+//   double   simulation time in seconds
+//   uint32_t node id of the receiving RSU
+//   uint16_t payload length
+//   uint8_t  payload[length] (the CAM exactly as received)
+//
+// All fields are written in host byte order. The log has no ns-3 dependency
+// so it can be read by tools that run outside the simulator.
+
+static const char CAM_TRACE_MAGIC[4] = {'C', 'A', 'M', 'T'};
+static const uint32_t CAM_TRACE_VERSION = 1;
+
+struct CAMTraceRecord {
+    double time;
+    uint32_t rsuId;
+    std::vector<uint8_t> payload;
+};
+
+class CAMTraceWriter {
+    public:
+        bool Open(const std::string& path);
+        bool IsOpen() const;
+        void Write(double time, uint32_t rsuId, const uint8_t* payload, uint16_t length);
+        void Close();
+    private:
+        std::ofstream m_file;
+        std::vector<char> m_buffer;
+};
+
+class CAMTraceReader {
+    public:
+        bool Open(const std::string& path);
+        bool Next(CAMTraceRecord& record);
+    private:
+        std::ifstream m_file;
+        std::vector<char> m_buffer;
+};
+
+inline bool CAMTraceWriter::Open(const std::string& path) {
+    // Large stream buffer, a busy RSU appends many small records
+    m_buffer.resize(1 << 20);
+    m_file.rdbuf()->pubsetbuf(m_buffer.data(), m_buffer.size());
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        return false;
+    }
+    m_file.write(CAM_TRACE_MAGIC, sizeof(CAM_TRACE_MAGIC));
+    m_file.write(reinterpret_cast<const char*>(&CAM_TRACE_VERSION), sizeof(CAM_TRACE_VERSION));
+    return true;
+}
+
+inline bool CAMTraceWriter::IsOpen() const {
+    return m_file.is_open();
+}
+
+inline void CAMTraceWriter::Write(double time, uint32_t rsuId, const uint8_t* payload, uint16_t length) {
+    m_file.write(reinterpret_cast<const char*>(&time), sizeof(time));
+    m_file.write(reinterpret_cast<const char*>(&rsuId), sizeof(rsuId));
+    m_file.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    m_file.write(reinterpret_cast<const char*>(payload), length);
+}
+
+inline void CAMTraceWriter::Close() {
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+}
+
+inline bool CAMTraceReader::Open(const std::string& path) {
+    m_buffer.resize(1 << 20);
+    m_file.rdbuf()->pubsetbuf(m_buffer.data(), m_buffer.size());
+    m_file.open(path, std::ios::binary);
+    if (!m_file) {
+        return false;
+    }
+
+    char magic[sizeof(CAM_TRACE_MAGIC)];
+    uint32_t version = 0;
+    m_file.read(magic, sizeof(magic));
+    m_file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    return m_file && std::memcmp(magic, CAM_TRACE_MAGIC, sizeof(magic)) == 0
+           && version == CAM_TRACE_VERSION;
+}
+
+inline bool CAMTraceReader::Next(CAMTraceRecord& record) {
+    uint16_t length = 0;
+    m_file.read(reinterpret_cast<char*>(&record.time), sizeof(record.time));
+    m_file.read(reinterpret_cast<char*>(&record.rsuId), sizeof(record.rsuId));
+    m_file.read(reinterpret_cast<char*>(&length), sizeof(length));
+    if (!m_file) {
+        return false;
+    }
+    record.payload.resize(length);
+    m_file.read(reinterpret_cast<char*>(record.payload.data()), length);
+    return static_cast<bool>(m_file);
+}
+
+#endif // CAM_TRACE_H
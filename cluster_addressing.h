@@ -0,0 +1,170 @@
+#ifndef CLUSTER_ADDRESSING_H
+#define CLUSTER_ADDRESSING_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace ns3;
+
+// Cluster-aligned addressing of the wireless network.
+//
+// The vehicles and RSUs share the 10.0.0.0/9 subnet. Every address is split
+// into a prefix above a host part: the host part is fixed per node, the
+// prefix says which cluster a vehicle is in. Prefix 0 holds the RSUs and the
+// vehicles that are not in a cluster yet. When an RSU clusters its vehicles,
+// every (RSU, cluster) pair gets a prefix of its own and vehicles that
+// changed cluster are re-addressed into it. The subnet mask stays at /9, so
+// the wireless link never depends on the cluster prefixes; they only exist
+// so that the controller can match a whole cluster with one masked rule.
+//
+// k-means labels are arbitrary, so a new clustering is matched to the RSU's
+// previous one by membership: every new cluster takes over the prefix most
+// of its members already hold, and only clusters without a match get a new
+// prefix. A stable cluster thus keeps its prefix and its controller rule.
+//
+// With more (RSU, cluster) pairs than prefixes, pairs share prefixes round
+// robin and the rules cover several clusters.
+class ClusterAddressing {
+    public:
+        // Splits the subnet so that numHosts nodes fit in the host part and
+        // uses at most numClusters cluster prefixes besides prefix 0
+        void Configure(uint32_t numHosts, uint32_t numClusters) {
+            NS_ABORT_MSG_IF(numClusters == 0, "Cluster addressing needs at least one cluster prefix");
+            m_hostBits = 1;
+            while ((1u << m_hostBits) < numHosts + 2) {
+                ++m_hostBits;
+            }
+            NS_ABORT_MSG_IF(m_hostBits >= SUBNET_BITS, "Too many nodes for cluster addressing");
+            m_numPrefixes = std::min(1u << (SUBNET_BITS - m_hostBits), numClusters + 1);
+            m_enabled = true;
+        }
+
+        bool IsEnabled() const { return m_enabled; }
+        uint32_t GetNumPrefixes() const { return m_numPrefixes; }
+        Ipv4Mask GetSubnetMask() const { return Ipv4Mask(0xffffffff << SUBNET_BITS); }
+        // Length of the cluster prefixes, used in the controller's rules
+        uint32_t GetPrefixLength() const { return 32 - m_hostBits; }
+
+        Ipv4Address GetPrefix(uint32_t prefix) const {
+            return Ipv4Address(SUBNET_BASE | (prefix << m_hostBits));
+        }
+
+        Ipv4Address GetAddress(uint32_t prefix, uint32_t host) const {
+            return Ipv4Address(SUBNET_BASE | (prefix << m_hostBits) | host);
+        }
+
+        // Gives the device its address in prefix 0. Vehicles are re-addressed
+        // later on, RSUs keep this one.
+        Ipv4Address AddDevice(Ptr<NetDevice> device, uint32_t host, bool vehicle) {
+            Ptr<Node> node = device->GetNode();
+            Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+            int32_t interface = ipv4->GetInterfaceForDevice(device);
+            if (interface == -1) {
+                interface = ipv4->AddInterface(device);
+            }
+            ipv4->AddAddress(interface, Ipv4InterfaceAddress(GetAddress(0, host), GetSubnetMask()));
+            ipv4->SetMetric(interface, 1);
+            ipv4->SetUp(interface);
+            if (vehicle) {
+                m_vehicles[node->GetId()] = {uint32_t(interface), host, 0};
+            }
+            return GetAddress(0, host);
+        }
+
+        // Moves the vehicles of an RSU's clustering into the prefixes of their
+        // clusters, label -1 (noise) moves a vehicle back to prefix 0
+        void AssignClusters(uint32_t rsuId, const std::vector<uint32_t>& vehicleIds, const std::vector<int>& labels) {
+            std::vector<uint32_t>& previous = m_rsuPrefixes[rsuId];
+            int numLabels = 0;
+            for (int label : labels) {
+                numLabels = std::max(numLabels, label + 1);
+            }
+
+            // Members every new cluster shares with each previous prefix
+            std::map<std::pair<int, uint32_t>, uint32_t> overlap;
+            for (size_t i = 0; i < vehicleIds.size(); ++i) {
+                auto it = m_vehicles.find(vehicleIds[i]);
+                if (labels[i] < 0 || it == m_vehicles.end() || it->second.prefix == 0) {
+                    continue;
+                }
+                if (std::find(previous.begin(), previous.end(), it->second.prefix) != previous.end()) {
+                    ++overlap[{labels[i], it->second.prefix}];
+                }
+            }
+            std::vector<std::pair<uint32_t, std::pair<int, uint32_t>>> matches;
+            for (const auto& entry : overlap) {
+                matches.emplace_back(entry.second, entry.first);
+            }
+            std::sort(matches.rbegin(), matches.rend());
+
+            // Largest overlaps first, every prefix goes to one cluster
+            std::vector<uint32_t> prefixes(numLabels, 0);
+            std::vector<uint32_t> unused = previous;
+            for (const auto& match : matches) {
+                int label = match.second.first;
+                auto it = std::find(unused.begin(), unused.end(), match.second.second);
+                if (prefixes[label] == 0 && it != unused.end()) {
+                    prefixes[label] = *it;
+                    unused.erase(it);
+                }
+            }
+            // Unmatched clusters reuse the RSU's leftover prefixes before new ones
+            for (int label = 0; label < numLabels; ++label) {
+                if (prefixes[label] != 0) {
+                    continue;
+                }
+                if (!unused.empty()) {
+                    prefixes[label] = unused.front();
+                    unused.erase(unused.begin());
+                } else {
+                    prefixes[label] = 1 + m_allocatedPrefixes++ % (m_numPrefixes - 1);
+                }
+            }
+            previous = prefixes;
+
+            for (size_t i = 0; i < vehicleIds.size(); ++i) {
+                Readdress(vehicleIds[i], labels[i] < 0 ? 0 : prefixes[labels[i]]);
+            }
+        }
+
+        uint64_t GetReaddressed() const { return m_readdressed; }
+
+    private:
+        void Readdress(uint32_t vehicleId, uint32_t prefix) {
+            auto it = m_vehicles.find(vehicleId);
+            if (it == m_vehicles.end() || it->second.prefix == prefix) {
+                return;
+            }
+            VehicleAddress& vehicle = it->second;
+            Ptr<Ipv4> ipv4 = NodeList::GetNode(vehicleId)->GetObject<Ipv4>();
+            ipv4->RemoveAddress(vehicle.interface, GetAddress(vehicle.prefix, vehicle.host));
+            ipv4->AddAddress(vehicle.interface,
+                             Ipv4InterfaceAddress(GetAddress(prefix, vehicle.host), GetSubnetMask()));
+            vehicle.prefix = prefix;
+            ++m_readdressed;
+        }
+
+        static const uint32_t SUBNET_BASE = 0x0a000000; // 10.0.0.0
+        static const uint32_t SUBNET_BITS = 23;         // host bits of the /9
+
+        struct VehicleAddress {
+            uint32_t interface;
+            uint32_t host;
+            uint32_t prefix;
+        };
+
+        bool m_enabled = false;
+        uint32_t m_hostBits = 0;
+        uint32_t m_numPrefixes = 0;
+        std::map<uint32_t, VehicleAddress> m_vehicles;
+        std::map<uint32_t, std::vector<uint32_t>> m_rsuPrefixes;  // prefix of every label, per RSU
+        uint32_t m_allocatedPrefixes = 0;
+        uint64_t m_readdressed = 0;
+};
+
+#endif // CLUSTER_ADDRESSING_H
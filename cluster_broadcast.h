@@ -0,0 +1,417 @@
+#ifndef CLUSTER_BROADCAST_H
+#define CLUSTER_BROADCAST_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Compact downlink message telling the vehicles of an RSU their clusters.
+//
+// After an epoch the RSU broadcasts the (vehicle id, cluster) pairs of the
+// vehicles it clustered together with the cluster centers. The message is
+// split into frames that fit one 802.11p broadcast each; every frame is
+// self-contained, so a vehicle only needs the frame holding its own id.
+//
+//   char     magic[2]      "CB"
+//   uint8_t  version
+//   uint8_t  encoding      0: runs, 1: bitmap
+//   uint32_t rsuId
+//   uint32_t epoch
+//   uint8_t  frameIndex
+//   uint8_t  frameCount
+//   uint16_t numClusters
+//   uint8_t  dims
+//   float    min[dims], step[dims]
+//   uint16_t centers[numClusters * dims]   center = min + q * step
+//   uint16_t numVehicles                    in this frame
+//   uint32_t baseId                         lowest vehicle id in this frame
+//
+// followed by the assignments of the frame, sorted by vehicle id:
+//
+//   runs    per run of consecutive ids in the same cluster:
+//           varint gap to the end of the previous run, varint length - 1,
+//           varint cluster
+//   bitmap  uint8_t label bits, varint span, one presence bit per id in
+//           [baseId, baseId + span), then one label per present id
+//
+// The encoder picks whichever of the two is smaller for every frame: runs
+// win for platoons of consecutive ids, the bitmap for dense id ranges with
+// mixed clusters. Unclustered vehicles are left out. Multi-byte fields are
+// in host byte order. Nothing in here depends on ns-3.
+
+static const char CLUSTER_BROADCAST_MAGIC[2] = {'C', 'B'};
+static const uint8_t CLUSTER_BROADCAST_VERSION = 1;
+
+struct ClusterBroadcast {
+    uint32_t rsuId = 0;
+    uint32_t epoch = 0;
+    int numClusters = 0;
+    int dims = 0;
+    std::vector<float> centers;                             // numClusters x dims
+    std::vector<std::pair<uint32_t, int32_t>> assignments;  // (vehicle id, cluster)
+
+    // Cluster of the vehicle, -1 when it is not in the message
+    int32_t FindCluster(uint32_t vehicleId) const {
+        auto it = std::lower_bound(assignments.begin(), assignments.end(),
+                                   std::make_pair(vehicleId, std::numeric_limits<int32_t>::min()));
+        return it != assignments.end() && it->first == vehicleId ? it->second : -1;
+    }
+};
+
+namespace cluster_broadcast {
+
+enum Encoding : uint8_t { RUNS = 0, BITMAP = 1 };
+
+inline size_t VarintSize(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+inline void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+inline bool GetVarint(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+inline void Put(std::vector<uint8_t>& out, T value) {
+    size_t offset = out.size();
+    out.resize(offset + sizeof(T));
+    std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+
+template <typename T>
+inline bool Get(const uint8_t*& data, const uint8_t* end, T& value) {
+    if (size_t(end - data) < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return true;
+}
+
+inline int LabelBits(int numClusters) {
+    int bits = 1;
+    while (bits < 16 && (1 << bits) < numClusters) {
+        ++bits;
+    }
+    return bits;
+}
+
+// Incremental size of both encodings while vehicles are appended in id order
+class SectionSize {
+    public:
+        explicit SectionSize(int labelBits) : m_labelBits(labelBits) {}
+
+        void Add(uint32_t id, int32_t cluster) {
+            if (m_count == 0) {
+                m_baseId = id;
+            }
+            if (m_count > 0 && id == m_lastId + 1 && cluster == m_runCluster) {
+                ++m_runLength;
+            } else {
+                m_closedRuns += RunBytes();
+                m_runGap = m_count == 0 ? 0 : id - m_lastId - 1;
+                m_runLength = 1;
+                m_runCluster = cluster;
+            }
+            m_lastId = id;
+            ++m_count;
+        }
+
+        size_t Runs() const { return m_closedRuns + RunBytes(); }
+
+        size_t Bitmap() const {
+            uint64_t span = m_count ? uint64_t(m_lastId) - m_baseId + 1 : 0;
+            return 1 + VarintSize(span) + (span + 7) / 8 + (m_count * m_labelBits + 7) / 8;
+        }
+
+        size_t Best() const { return std::min(Runs(), Bitmap()); }
+
+    private:
+        size_t RunBytes() const {
+            return m_runLength ? VarintSize(m_runGap) + VarintSize(m_runLength - 1) + VarintSize(m_runCluster) : 0;
+        }
+
+        int m_labelBits;
+        size_t m_count = 0;
+        uint32_t m_baseId = 0;
+        uint32_t m_lastId = 0;
+        size_t m_closedRuns = 0;
+        uint64_t m_runGap = 0;
+        uint64_t m_runLength = 0;
+        int32_t m_runCluster = 0;
+};
+
+} // namespace cluster_broadcast
+
+// Splits the message into frames of at most maxFrameBytes (the centers and
+// the header are repeated in every frame). Returns no frames when the
+// message needs more than the 255 frames the header can number.
+inline std::vector<std::vector<uint8_t>> EncodeClusterBroadcast(const ClusterBroadcast& message,
+                                                                size_t maxFrameBytes = 1400) {
+    using namespace cluster_broadcast;
+
+    std::vector<std::pair<uint32_t, int32_t>> assignments;
+    for (const auto& assignment : message.assignments) {
+        if (assignment.second >= 0) {
+            assignments.push_back(assignment);
+        }
+    }
+    std::sort(assignments.begin(), assignments.end());
+    assignments.erase(std::unique(assignments.begin(), assignments.end(),
+                                  [](const auto& a, const auto& b) { return a.first == b.first; }),
+                      assignments.end());
+
+    int numClusters = message.numClusters;
+    int dims = message.dims;
+    int labelBits = LabelBits(numClusters);
+
+    // Per dimension quantization of the centers to 16 bits
+    std::vector<float> minValue(dims, 0.0f);
+    std::vector<float> step(dims, 0.0f);
+    for (int d = 0; d < dims; ++d) {
+        float low = std::numeric_limits<float>::max();
+        float high = std::numeric_limits<float>::lowest();
+        for (int c = 0; c < numClusters; ++c) {
+            low = std::min(low, message.centers[size_t(c) * dims + d]);
+            high = std::max(high, message.centers[size_t(c) * dims + d]);
+        }
+        if (numClusters > 0) {
+            minValue[d] = low;
+            step[d] = (high - low) / 65535.0f;
+        }
+    }
+
+    // Frame boundaries: add vehicles while the smaller encoding still fits
+    size_t fixedBytes = 2 + 1 + 1 + 4 + 4 + 1 + 1 + 2 + 1 + dims * 8 + size_t(numClusters) * dims * 2 + 2 + 4;
+    std::vector<size_t> bounds = {0};
+    SectionSize size(labelBits);
+    for (size_t i = 0; i < assignments.size(); ++i) {
+        SectionSize grown = size;
+        grown.Add(assignments[i].first, assignments[i].second);
+        size_t frameVehicles = i - bounds.back();
+        if (frameVehicles > 0 && (fixedBytes + grown.Best() > maxFrameBytes || frameVehicles == 0xffff)) {
+            bounds.push_back(i);
+            grown = SectionSize(labelBits);
+            grown.Add(assignments[i].first, assignments[i].second);
+        }
+        size = grown;
+    }
+    bounds.push_back(assignments.size());
+    size_t frameCount = bounds.size() - 1;
+    if (frameCount > 255) {
+        return {};
+    }
+
+    std::vector<std::vector<uint8_t>> frames;
+    for (size_t f = 0; f < frameCount; ++f) {
+        size_t begin = bounds[f];
+        size_t end = bounds[f + 1];
+        SectionSize section(labelBits);
+        for (size_t i = begin; i < end; ++i) {
+            section.Add(assignments[i].first, assignments[i].second);
+        }
+        Encoding encoding = section.Runs() <= section.Bitmap() ? RUNS : BITMAP;
+        uint32_t baseId = begin < end ? assignments[begin].first : 0;
+
+        std::vector<uint8_t> frame;
+        frame.insert(frame.end(), CLUSTER_BROADCAST_MAGIC, CLUSTER_BROADCAST_MAGIC + 2);
+        Put<uint8_t>(frame, CLUSTER_BROADCAST_VERSION);
+        Put<uint8_t>(frame, encoding);
+        Put<uint32_t>(frame, message.rsuId);
+        Put<uint32_t>(frame, message.epoch);
+        Put<uint8_t>(frame, f);
+        Put<uint8_t>(frame, frameCount);
+        Put<uint16_t>(frame, numClusters);
+        Put<uint8_t>(frame, dims);
+        for (int d = 0; d < dims; ++d) {
+            Put<float>(frame, minValue[d]);
+        }
+        for (int d = 0; d < dims; ++d) {
+            Put<float>(frame, step[d]);
+        }
+        for (int c = 0; c < numClusters; ++c) {
+            for (int d = 0; d < dims; ++d) {
+                float value = message.centers[size_t(c) * dims + d];
+                uint16_t q = step[d] > 0 ? uint16_t(std::lround((value - minValue[d]) / step[d])) : 0;
+                Put<uint16_t>(frame, q);
+            }
+        }
+        Put<uint16_t>(frame, end - begin);
+        Put<uint32_t>(frame, baseId);
+
+        if (encoding == RUNS) {
+            uint32_t nextId = baseId;
+            for (size_t i = begin; i < end;) {
+                size_t j = i + 1;
+                while (j < end && assignments[j].first == assignments[j - 1].first + 1
+                       && assignments[j].second == assignments[i].second) {
+                    ++j;
+                }
+                PutVarint(frame, assignments[i].first - nextId);
+                PutVarint(frame, j - i - 1);
+                PutVarint(frame, assignments[i].second);
+                nextId = assignments[j - 1].first + 1;
+                i = j;
+            }
+        } else {
+            uint64_t span = end > begin ? uint64_t(assignments[end - 1].first) - baseId + 1 : 0;
+            Put<uint8_t>(frame, labelBits);
+            PutVarint(frame, span);
+            size_t presence = frame.size();
+            frame.resize(presence + (span + 7) / 8, 0);
+            for (size_t i = begin; i < end; ++i) {
+                uint64_t bit = assignments[i].first - baseId;
+                frame[presence + bit / 8] |= uint8_t(1u << (bit % 8));
+            }
+            size_t labels = frame.size();
+            frame.resize(labels + ((end - begin) * labelBits + 7) / 8, 0);
+            size_t bit = 0;
+            for (size_t i = begin; i < end; ++i) {
+                for (int b = 0; b < labelBits; ++b, ++bit) {
+                    if (assignments[i].second & (1 << b)) {
+                        frame[labels + bit / 8] |= uint8_t(1u << (bit % 8));
+                    }
+                }
+            }
+        }
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+// Decodes one frame; the message gets the frame's assignments and the
+// dequantized centers
+inline bool DecodeClusterBroadcast(const uint8_t* data, size_t length, ClusterBroadcast& message,
+                                   int* frameIndex = nullptr, int* frameCount = nullptr) {
+    using namespace cluster_broadcast;
+    const uint8_t* end = data + length;
+    if (length < 4 || std::memcmp(data, CLUSTER_BROADCAST_MAGIC, 2) != 0 || data[2] != CLUSTER_BROADCAST_VERSION) {
+        return false;
+    }
+    uint8_t encoding = data[3];
+    data += 4;
+
+    uint8_t index;
+    uint8_t count;
+    uint16_t numClusters;
+    uint8_t dims;
+    if (!Get(data, end, message.rsuId) || !Get(data, end, message.epoch) || !Get(data, end, index)
+        || !Get(data, end, count) || !Get(data, end, numClusters) || !Get(data, end, dims)) {
+        return false;
+    }
+    message.numClusters = numClusters;
+    message.dims = dims;
+
+    std::vector<float> minValue(dims);
+    std::vector<float> step(dims);
+    for (int d = 0; d < dims; ++d) {
+        if (!Get(data, end, minValue[d])) {
+            return false;
+        }
+    }
+    for (int d = 0; d < dims; ++d) {
+        if (!Get(data, end, step[d])) {
+            return false;
+        }
+    }
+    message.centers.assign(size_t(numClusters) * dims, 0.0f);
+    for (size_t i = 0; i < message.centers.size(); ++i) {
+        uint16_t q;
+        if (!Get(data, end, q)) {
+            return false;
+        }
+        message.centers[i] = minValue[i % dims] + q * step[i % dims];
+    }
+
+    uint16_t numVehicles;
+    uint32_t baseId;
+    if (!Get(data, end, numVehicles) || !Get(data, end, baseId)) {
+        return false;
+    }
+    message.assignments.clear();
+    message.assignments.reserve(numVehicles);
+
+    if (encoding == RUNS) {
+        uint64_t nextId = baseId;
+        while (message.assignments.size() < numVehicles) {
+            uint64_t gap;
+            uint64_t extra;
+            uint64_t cluster;
+            // Bounds are checked before any arithmetic so nothing can wrap
+            if (!GetVarint(data, end, gap) || !GetVarint(data, end, extra) || !GetVarint(data, end, cluster)
+                || extra >= numVehicles || message.assignments.size() + extra + 1 > numVehicles
+                || gap > std::numeric_limits<uint32_t>::max() || cluster >= numClusters
+                || nextId + gap + extra > std::numeric_limits<uint32_t>::max()) {
+                return false;
+            }
+            nextId += gap;
+            for (uint64_t r = 0; r <= extra; ++r) {
+                message.assignments.emplace_back(uint32_t(nextId++), int32_t(cluster));
+            }
+        }
+    } else if (encoding == BITMAP) {
+        uint8_t labelBits;
+        uint64_t span;
+        if (!Get(data, end, labelBits) || labelBits == 0 || labelBits > 16 || !GetVarint(data, end, span)
+            || span > 8 * uint64_t(end - data) || baseId + span > uint64_t(std::numeric_limits<uint32_t>::max()) + 1) {
+            return false;
+        }
+        const uint8_t* presence = data;
+        data += (span + 7) / 8;
+        if (size_t(end - data) < (size_t(numVehicles) * labelBits + 7) / 8) {
+            return false;
+        }
+        size_t bit = 0;
+        for (uint64_t offset = 0; offset < span && message.assignments.size() < numVehicles; ++offset) {
+            if (!(presence[offset / 8] & (1u << (offset % 8)))) {
+                continue;
+            }
+            int32_t cluster = 0;
+            for (int b = 0; b < labelBits; ++b, ++bit) {
+                if (data[bit / 8] & (1u << (bit % 8))) {
+                    cluster |= 1 << b;
+                }
+            }
+            if (cluster >= numClusters) {
+                return false;
+            }
+            message.assignments.emplace_back(uint32_t(baseId + offset), cluster);
+        }
+    } else {
+        return false;
+    }
+
+    if (frameIndex) {
+        *frameIndex = index;
+    }
+    if (frameCount) {
+        *frameCount = count;
+    }
+    return message.assignments.size() == numVehicles;
+}
+
+#endif // CLUSTER_BROADCAST_H
@@ -0,0 +1,333 @@
+#ifndef CLUSTER_FEED_H
+#define CLUSTER_FEED_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Live feed of clustering results in POSIX shared memory.
+//
+// The simulator is the single producer and publishes one record per
+// clustering epoch into a ring of fixed-size slots. Any number of readers map
+// the same segment read-only and follow it at their own pace. Every slot is
+// guarded by a sequence number (odd while the slot is being written), so the
+// producer never waits for readers: a reader that falls more than a ring
+// behind skips ahead and counts the records it missed.
+//
+// Records hold the epoch, RSU id, simulation time, the centers and the
+// (vehicle id, cluster) assignments. Assignments that do not fit into a slot
+// are cut off and the record is flagged as truncated. A record whose centers
+// alone do not fit is not published; the segment header counts those, so
+// readers see them as rejected.
+
+static const char CLUSTER_FEED_MAGIC[8] = {'C', 'L', 'F', 'E', 'E', 'D', '0', '1'};
+
+struct ClusterFeedRecord {
+    uint64_t epoch = 0;
+    uint32_t rsuId = 0;
+    double simTime = 0.0;
+    int numClusters = 0;
+    int dims = 0;
+    std::vector<float> centers;                             // numClusters x dims
+    std::vector<std::pair<uint32_t, int32_t>> assignments;  // vehicle id, cluster
+    bool truncated = false;
+};
+
+struct ClusterFeedHeader {
+    char magic[8];
+    uint32_t slotCount;
+    uint32_t slotSize;
+    std::atomic<uint64_t> published;  // records written so far
+    std::atomic<uint64_t> rejected;   // records too large for a slot, never written
+};
+
+struct ClusterFeedSlot {
+    std::atomic<uint64_t> sequence;   // 2r+1 while record r is written, 2r+2 once complete
+    uint32_t length;
+    // followed by slotSize bytes of record data
+};
+
+struct ClusterFeedRecordHeader {
+    uint64_t epoch;
+    double simTime;
+    uint32_t rsuId;
+    uint32_t numClusters;
+    uint32_t dims;
+    uint32_t numAssignments;
+    uint32_t truncated;
+    uint32_t reserved;
+};
+
+inline size_t ClusterFeedSlotStride(uint32_t slotSize) {
+    size_t stride = sizeof(ClusterFeedSlot) + slotSize;
+    return (stride + 63) & ~size_t(63);
+}
+
+inline size_t ClusterFeedSegmentSize(uint32_t slotCount, uint32_t slotSize) {
+    return ((sizeof(ClusterFeedHeader) + 63) & ~size_t(63)) + slotCount * ClusterFeedSlotStride(slotSize);
+}
+
+inline ClusterFeedSlot* ClusterFeedGetSlot(void* base, uint32_t slotSize, uint64_t index) {
+    uint8_t* slots = static_cast<uint8_t*>(base) + ((sizeof(ClusterFeedHeader) + 63) & ~size_t(63));
+    return reinterpret_cast<ClusterFeedSlot*>(slots + index * ClusterFeedSlotStride(slotSize));
+}
+
+class ClusterFeedWriter {
+    public:
+        ~ClusterFeedWriter();
+        // Creates (or replaces) the segment, name follows shm_open rules ("/name")
+        bool Create(const std::string& name, uint32_t slotCount = 64, uint32_t slotSize = 256 * 1024);
+        bool IsOpen() const { return m_base != nullptr; }
+        // False when the record's centers do not fit into a slot, the record
+        // is then dropped and counted as rejected
+        bool Publish(const ClusterFeedRecord& record);
+        uint64_t GetRejected() const { return m_header ? m_header->rejected.load(std::memory_order_relaxed) : 0; }
+        // Unmaps and removes the segment, attached readers keep their mapping
+        void Close();
+    private:
+        std::string m_name;
+        void* m_base = nullptr;
+        size_t m_size = 0;
+        ClusterFeedHeader* m_header = nullptr;
+        std::vector<uint8_t> m_scratch;
+};
+
+class ClusterFeedReader {
+    public:
+        ~ClusterFeedReader();
+        // Attaches to a feed; with fromOldest the reader starts at the oldest
+        // record still in the ring, otherwise at the next one published
+        bool Open(const std::string& name, bool fromOldest = false);
+        // Returns true and fills record when a new record is available
+        bool Poll(ClusterFeedRecord& record);
+        uint64_t GetDropped() const { return m_dropped; }
+        // Records the producer could not fit into a slot
+        uint64_t GetRejected() const { return m_header ? m_header->rejected.load(std::memory_order_acquire) : 0; }
+        void Close();
+    private:
+        void* m_base = nullptr;
+        size_t m_size = 0;
+        const ClusterFeedHeader* m_header = nullptr;
+        uint64_t m_next = 0;
+        uint64_t m_dropped = 0;
+        std::vector<uint8_t> m_scratch;
+};
+
+inline ClusterFeedWriter::~ClusterFeedWriter() {
+    Close();
+}
+
+inline bool ClusterFeedWriter::Create(const std::string& name, uint32_t slotCount, uint32_t slotSize) {
+    Close();
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    m_size = ClusterFeedSegmentSize(slotCount, slotSize);
+    if (ftruncate(fd, m_size) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* base = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // The segment is zero filled, so every slot sequence starts at 0 (empty)
+    m_base = base;
+    m_name = name;
+    m_header = new (m_base) ClusterFeedHeader;
+    m_header->slotCount = slotCount;
+    m_header->slotSize = slotSize;
+    m_header->published.store(0, std::memory_order_relaxed);
+    m_header->rejected.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(m_header->magic, CLUSTER_FEED_MAGIC, sizeof(CLUSTER_FEED_MAGIC));
+    return true;
+}
+
+inline bool ClusterFeedWriter::Publish(const ClusterFeedRecord& record) {
+    if (!m_base) {
+        return false;
+    }
+
+    // Serialize into a local buffer first so the slot is held odd briefly
+    size_t centerBytes = record.centers.size() * sizeof(float);
+    if (m_header->slotSize < sizeof(ClusterFeedRecordHeader)
+        || centerBytes > m_header->slotSize - sizeof(ClusterFeedRecordHeader)) {
+        // Single producer, no read-modify-write needed
+        m_header->rejected.store(m_header->rejected.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        return false;
+    }
+    size_t room = m_header->slotSize - sizeof(ClusterFeedRecordHeader);
+    size_t pairSize = sizeof(uint32_t) + sizeof(int32_t);
+    size_t numAssignments = std::min(record.assignments.size(), (room - centerBytes) / pairSize);
+
+    ClusterFeedRecordHeader header = {};
+    header.epoch = record.epoch;
+    header.simTime = record.simTime;
+    header.rsuId = record.rsuId;
+    header.numClusters = record.numClusters;
+    header.dims = record.dims;
+    header.numAssignments = numAssignments;
+    header.truncated = record.truncated || numAssignments < record.assignments.size();
+
+    m_scratch.resize(sizeof(header) + centerBytes + numAssignments * pairSize);
+    uint8_t* out = m_scratch.data();
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    std::memcpy(out, record.centers.data(), centerBytes);
+    out += centerBytes;
+    for (size_t i = 0; i < numAssignments; ++i) {
+        std::memcpy(out, &record.assignments[i].first, sizeof(uint32_t));
+        std::memcpy(out + sizeof(uint32_t), &record.assignments[i].second, sizeof(int32_t));
+        out += pairSize;
+    }
+
+    uint64_t index = m_header->published.load(std::memory_order_relaxed);
+    ClusterFeedSlot* slot = ClusterFeedGetSlot(m_base, m_header->slotSize, index % m_header->slotCount);
+    slot->sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->length = m_scratch.size();
+    std::memcpy(reinterpret_cast<uint8_t*>(slot + 1), m_scratch.data(), m_scratch.size());
+    slot->sequence.store(2 * index + 2, std::memory_order_release);
+    m_header->published.store(index + 1, std::memory_order_release);
+    return true;
+}
+
+inline void ClusterFeedWriter::Close() {
+    if (m_base) {
+        munmap(m_base, m_size);
+        shm_unlink(m_name.c_str());
+        m_base = nullptr;
+        m_header = nullptr;
+    }
+}
+
+inline ClusterFeedReader::~ClusterFeedReader() {
+    Close();
+}
+
+inline bool ClusterFeedReader::Open(const std::string& name, bool fromOldest) {
+    Close();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(ClusterFeedHeader)) {
+        close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    m_base = base;
+    m_size = info.st_size;
+    m_header = static_cast<const ClusterFeedHeader*>(m_base);
+    if (std::memcmp(m_header->magic, CLUSTER_FEED_MAGIC, sizeof(CLUSTER_FEED_MAGIC)) != 0
+        || ClusterFeedSegmentSize(m_header->slotCount, m_header->slotSize) > m_size) {
+        Close();
+        return false;
+    }
+
+    uint64_t published = m_header->published.load(std::memory_order_acquire);
+    m_next = published;
+    if (fromOldest) {
+        m_next = published > m_header->slotCount ? published - m_header->slotCount : 0;
+    }
+    m_dropped = 0;
+    return true;
+}
+
+inline bool ClusterFeedReader::Poll(ClusterFeedRecord& record) {
+    if (!m_base) {
+        return false;
+    }
+
+    while (true) {
+        uint64_t published = m_header->published.load(std::memory_order_acquire);
+        if (m_next >= published) {
+            return false;
+        }
+        // Lapped by the producer, skip to the oldest record still in the ring
+        if (published - m_next > m_header->slotCount) {
+            m_dropped += published - m_header->slotCount - m_next;
+            m_next = published - m_header->slotCount;
+        }
+
+        const ClusterFeedSlot* slot = ClusterFeedGetSlot(m_base, m_header->slotSize, m_next % m_header->slotCount);
+        uint64_t before = slot->sequence.load(std::memory_order_acquire);
+        if (before != 2 * m_next + 2) {
+            // Being overwritten right now, count it as missed
+            ++m_dropped;
+            ++m_next;
+            continue;
+        }
+        uint32_t length = std::min<uint32_t>(slot->length, m_header->slotSize);
+        m_scratch.resize(length);
+        std::memcpy(m_scratch.data(), reinterpret_cast<const uint8_t*>(slot + 1), length);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) != before) {
+            ++m_dropped;
+            ++m_next;
+            continue;
+        }
+        ++m_next;
+
+        ClusterFeedRecordHeader header;
+        if (length < sizeof(header)) {
+            continue;
+        }
+        std::memcpy(&header, m_scratch.data(), sizeof(header));
+        size_t centerCount = size_t(header.numClusters) * header.dims;
+        size_t pairSize = sizeof(uint32_t) + sizeof(int32_t);
+        if (sizeof(header) + centerCount * sizeof(float) + header.numAssignments * pairSize > length) {
+            continue;
+        }
+
+        const uint8_t* in = m_scratch.data() + sizeof(header);
+        record.epoch = header.epoch;
+        record.simTime = header.simTime;
+        record.rsuId = header.rsuId;
+        record.numClusters = header.numClusters;
+        record.dims = header.dims;
+        record.truncated = header.truncated;
+        record.centers.resize(centerCount);
+        std::memcpy(record.centers.data(), in, centerCount * sizeof(float));
+        in += centerCount * sizeof(float);
+        record.assignments.resize(header.numAssignments);
+        for (auto& assignment : record.assignments) {
+            std::memcpy(&assignment.first, in, sizeof(uint32_t));
+            std::memcpy(&assignment.second, in + sizeof(uint32_t), sizeof(int32_t));
+            in += pairSize;
+        }
+        return true;
+    }
+}
+
+inline void ClusterFeedReader::Close() {
+    if (m_base) {
+        munmap(m_base, m_size);
+        m_base = nullptr;
+        m_header = nullptr;
+    }
+}
+
+#endif // CLUSTER_FEED_H
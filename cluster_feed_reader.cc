@@ -0,0 +1,38 @@
+// Prints the cluster updates a running vehicular_network publishes with
+// --clusterFeed. Minimal example of a ClusterFeedReader consumer.
+//
+//   cluster_feed_reader [/feed-name]
+
+#include "cluster_feed.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+int main(int argc, char* argv[]) {
+    std::string name = argc > 1 ? argv[1] : "/vanet-clusters";
+
+    ClusterFeedReader reader;
+    while (!reader.Open(name, true)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    std::cout << "Attached to " << name << std::endl;
+
+    ClusterFeedRecord record;
+    while (true) {
+        if (!reader.Poll(record)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        std::cout << "t=" << record.simTime << "s RSU " << record.rsuId << " epoch " << record.epoch << ": "
+                  << record.numClusters << " clusters, " << record.assignments.size() << " vehicles"
+                  << (record.truncated ? " (truncated)" : "") << ", " << reader.GetDropped() << " missed, "
+                  << reader.GetRejected() << " rejected by the producer" << std::endl;
+        for (int c = 0; c < record.numClusters; ++c) {
+            std::cout << "  cluster " << c << ":";
+            for (int d = 0; d < record.dims; ++d) {
+                std::cout << " " << record.centers[c * record.dims + d];
+            }
+            std::cout << std::endl;
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef CLUSTER_INDEX_H
+#define CLUSTER_INDEX_H
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+#include "cam_clustering.h"
+
+// Vehicle to cluster index.
+//
+// Entries live in a vector indexed by vehicle id (the vehicles' node ids
+// are small and dense), so a lookup is a bounds check and an array access.
+// Every completed clustering epoch rewrites the entries of the vehicles it
+// clustered and keeps the centers per RSU. In between, every new CAM moves
+// its vehicle to the nearest of its RSU's current centers, so the index
+// follows the vehicles without waiting for the next epoch.
+// Nothing in here depends on ns-3.
+
+struct ClusterMembership {
+    static const uint32_t NO_RSU = std::numeric_limits<uint32_t>::max();
+
+    int32_t cluster = -1;      // label in the RSU's clustering, -1 is unclustered
+    uint32_t rsuId = NO_RSU;   // RSU whose clustering the label belongs to
+    uint32_t epoch = 0;        // epoch of the centers the vehicle was matched with
+    float distance = 0.0f;     // feature distance to the cluster center
+
+    bool IsClustered() const { return cluster >= 0; }
+};
+
+template <typename Schema = DefaultCAMSchema>
+class ClusterIndex {
+    public:
+        // Records the result of an RSU's clustering run over the CAMs
+        void Update(const std::vector<CAMData>& cams, const ClusteringResult& result, uint32_t rsuId, uint32_t epoch) {
+            RsuCenters& rsu = m_rsus[rsuId];
+            rsu.centers = result.centers;
+            rsu.numClusters = result.dims == Schema::DIMS ? result.numClusters : 0;
+            rsu.epoch = epoch;
+
+            float row[Schema::DIMS];
+            for (size_t i = 0; i < cams.size(); ++i) {
+                ClusterMembership& entry = Entry(cams[i].id);
+                entry.cluster = result.labels[i];
+                entry.rsuId = rsuId;
+                entry.epoch = epoch;
+                entry.distance = 0.0f;
+                if (entry.cluster >= 0 && rsu.numClusters) {
+                    Schema::Extract(cams[i], row);
+                    entry.distance = std::sqrt(Schema::SquaredDistance(row, rsu.Center(entry.cluster)));
+                }
+            }
+        }
+
+        // Moves the CAM's vehicle to the nearest center of the RSU's last
+        // clustering. Nothing changes before the RSU's first epoch.
+        void Observe(const CAMData& cam, uint32_t rsuId) {
+            auto it = m_rsus.find(rsuId);
+            if (it == m_rsus.end() || it->second.numClusters == 0) {
+                return;
+            }
+            const RsuCenters& rsu = it->second;
+            float row[Schema::DIMS];
+            Schema::Extract(cam, row);
+            int best = 0;
+            double bestDistance = std::numeric_limits<double>::max();
+            for (int c = 0; c < rsu.numClusters; ++c) {
+                double distance = Schema::SquaredDistance(row, rsu.Center(c));
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = c;
+                }
+            }
+
+            ClusterMembership& entry = Entry(cam.id);
+            entry.cluster = best;
+            entry.rsuId = rsuId;
+            entry.epoch = rsu.epoch;
+            entry.distance = std::sqrt(bestDistance);
+        }
+
+        // The vehicle's entry; unknown vehicles are unclustered
+        const ClusterMembership& Lookup(uint32_t vehicleId) const {
+            static const ClusterMembership unknown;
+            return vehicleId < m_entries.size() ? m_entries[vehicleId] : unknown;
+        }
+
+        // Vehicles with an entry, clustered or not
+        size_t GetNumVehicles() const { return m_numVehicles; }
+
+        void Clear() {
+            m_entries.clear();
+            m_rsus.clear();
+            m_numVehicles = 0;
+        }
+
+    private:
+        struct RsuCenters {
+            std::vector<float> centers;
+            int numClusters = 0;
+            uint32_t epoch = 0;
+
+            const float* Center(int c) const { return centers.data() + size_t(c) * Schema::DIMS; }
+        };
+
+        ClusterMembership& Entry(uint32_t vehicleId) {
+            if (vehicleId >= m_entries.size()) {
+                m_entries.resize(vehicleId + 1);
+            }
+            if (m_entries[vehicleId].rsuId == ClusterMembership::NO_RSU) {
+                ++m_numVehicles;
+            }
+            return m_entries[vehicleId];
+        }
+
+        std::vector<ClusterMembership> m_entries;
+        std::unordered_map<uint32_t, RsuCenters> m_rsus;
+        size_t m_numVehicles = 0;
+};
+
+#endif // CLUSTER_INDEX_H
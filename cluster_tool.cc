@@ -0,0 +1,169 @@
+// Offline clustering of recorded CAMs, without ns-3.
+//
+// Reads CAM traces written with --camTrace (*.bin) or cluster<N>.csv files,
+// splits the CAMs into time windows and clusters the windows in parallel.
+// Traces are windowed by simulation time; CSV files carry no time, so all
+// their points go into window 0.
+//
+//   cluster_tool [--window=SECONDS] [--engine=kmeans|grid|auto] [--clusters=K]
+//                [--threads=N] [--output=PREFIX] input...
+//
+// Writes PREFIX_labels.csv (window,posX,posY,speed,id,cluster) and
+// PREFIX_centers.csv (window,cluster,feature...).
+
+#include "cam_clustering.h"
+#include "cam_trace.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+struct ToolOptions {
+    double window = 0.0;
+    std::string engine = "kmeans";
+    int numClusters = 4;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string output = "clusters";
+    std::vector<std::string> inputs;
+};
+
+static bool ParseOptions(int argc, char* argv[], ToolOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        // stod and stoi throw on values that are not numbers or out of range
+        try {
+            if (arg.rfind("--window=", 0) == 0) {
+                options.window = std::stod(value);
+            } else if (arg.rfind("--engine=", 0) == 0) {
+                options.engine = value;
+            } else if (arg.rfind("--clusters=", 0) == 0) {
+                options.numClusters = std::stoi(value);
+            } else if (arg.rfind("--threads=", 0) == 0) {
+                options.threads = std::max(1, std::stoi(value));
+            } else if (arg.rfind("--output=", 0) == 0) {
+                options.output = value;
+            } else if (arg.rfind("--", 0) == 0) {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            } else {
+                options.inputs.push_back(arg);
+            }
+        } catch (const std::logic_error&) {
+            std::cerr << "Invalid value in " << arg << std::endl;
+            return false;
+        }
+    }
+    return !options.inputs.empty() && options.numClusters > 0;
+}
+
+static bool EndsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size()
+           && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Loads every input into a map from window index to CAMs
+static bool LoadInputs(const ToolOptions& options, std::map<int64_t, std::vector<CAMData>>& windows) {
+    for (const auto& path : options.inputs) {
+        if (EndsWith(path, ".csv")) {
+            if (!ReadClusterCSV(path, windows[0])) {
+                std::cerr << "Cannot read " << path << std::endl;
+                return false;
+            }
+            continue;
+        }
+
+        CAMTraceReader reader;
+        if (!reader.Open(path)) {
+            std::cerr << "Cannot read CAM trace " << path << std::endl;
+            return false;
+        }
+        CAMTraceRecord record;
+        while (reader.Next(record)) {
+            CAMData data = {};
+            CAMWireSchema::Decode(record.payload.data(), record.payload.size(), data);
+            int64_t window = options.window > 0 ? std::floor(record.time / options.window) : 0;
+            windows[window].push_back(data);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    ToolOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--window=SECONDS] [--engine=kmeans|grid|auto] [--clusters=K] [--threads=N]"
+                  << " [--output=PREFIX] input..." << std::endl;
+        return 1;
+    }
+
+    std::map<int64_t, std::vector<CAMData>> windows;
+    if (!LoadInputs(options, windows)) {
+        return 1;
+    }
+
+    std::vector<int64_t> windowIds;
+    std::vector<const std::vector<CAMData>*> windowData;
+    for (const auto& window : windows) {
+        windowIds.push_back(window.first);
+        windowData.push_back(&window.second);
+    }
+
+    if (!CreateClusteringEngine(options.engine, options.numClusters)) {
+        std::cerr << "Unknown clustering engine " << options.engine << std::endl;
+        return 1;
+    }
+
+    // Windows already keep the cores busy, so k-means (on its own or inside
+    // the auto engine) runs its restarts inline
+    KMeansOptions kmeansOptions;
+    kmeansOptions.threads = 1;
+
+    // Every window is independent, workers take the next one until none is
+    // left. Engines keep per-run state, so each worker gets its own.
+    std::vector<ClusteringResult> results(windowIds.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    unsigned numWorkers = std::min<size_t>(options.threads, std::max<size_t>(1, windowIds.size()));
+    for (unsigned t = 0; t < numWorkers; ++t) {
+        workers.emplace_back([&]() {
+            std::unique_ptr<ClusteringEngine> engine =
+                CreateClusteringEngine(options.engine, options.numClusters, kmeansOptions);
+            for (size_t i = next++; i < windowIds.size(); i = next++) {
+                results[i] = ClusterCAMData(*windowData[i], *engine);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::ofstream labelsFile(options.output + "_labels.csv");
+    std::ofstream centersFile(options.output + "_centers.csv");
+    size_t numPoints = 0;
+    for (size_t i = 0; i < windowIds.size(); ++i) {
+        const ClusteringResult& result = results[i];
+        const std::vector<CAMData>& cams = *windowData[i];
+        for (size_t p = 0; p < cams.size(); ++p) {
+            labelsFile << windowIds[i] << ",";
+            CAMCSVSchema::WriteCAM(labelsFile, cams[p]);
+            labelsFile << "," << result.labels[p] << "\n";
+        }
+        for (int c = 0; c < result.numClusters; ++c) {
+            centersFile << windowIds[i] << "," << c;
+            for (int d = 0; d < result.dims; ++d) {
+                centersFile << "," << result.Center(c, d);
+            }
+            centersFile << "\n";
+        }
+        numPoints += cams.size();
+    }
+
+    std::cout << "Clustered " << numPoints << " CAMs in " << windowIds.size() << " windows using "
+              << numWorkers << " threads with the " << options.engine << " engine" << std::endl;
+    return 0;
+}
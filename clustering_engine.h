@@ -0,0 +1,296 @@
+#ifndef CLUSTERING_ENGINE_H
+#define CLUSTERING_ENGINE_H
+
+#include <array>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "kmeans.h"
+
+// Interface behind the RSU clustering. Engines take a row major
+// numPoints x dims matrix and return a label per point plus the centers.
+// Points an engine leaves unclustered are labelled -1.
+//
+// Iterative engines honour a budget: once the wall-clock deadline passes or
+// the work budget is used up they return the best solution found so far and
+// flag it as not converged. Single-pass engines ignore it.
+struct ClusteringBudget {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    uint64_t workUnits = 0;  // 0 is unlimited
+};
+
+class ClusteringEngine {
+    public:
+        virtual ~ClusteringEngine() {}
+        virtual std::string GetName() const = 0;
+        virtual ClusteringResult Cluster(const std::vector<float>& points, int dims) = 0;
+        virtual void SetBudget(const ClusteringBudget&) {}
+};
+
+// Fixed-k k-means (see kmeans.h)
+class KMeansEngine : public ClusteringEngine {
+    public:
+        KMeansEngine(int numClusters, const KMeansOptions& options = KMeansOptions());
+        std::string GetName() const override { return "kmeans"; }
+        ClusteringResult Cluster(const std::vector<float>& points, int dims) override;
+        void SetBudget(const ClusteringBudget& budget) override;
+        const KMeansStats& GetLastStats() const { return m_stats; }
+    private:
+        int m_numClusters;
+        KMeansOptions m_options;
+        KMeansStats m_stats;
+};
+
+// DBSCAN-style density clustering on a uniform grid.
+//
+// The first GRID_DIMS features (position and speed) are hashed into cells of
+// the given size. A cell is dense when its 3x3x3 neighbourhood holds at least
+// minPoints points; neighbouring dense cells are merged into one cluster and
+// the points of sparse cells join a dense neighbour if they have one, and are
+// noise otherwise. Every step is a single pass over the points or the
+// occupied cells, so the cost is linear in the number of points and the
+// number of clusters follows the data instead of being fixed.
+class GridDensityEngine : public ClusteringEngine {
+    public:
+        static const int GRID_DIMS = 3;
+
+        GridDensityEngine(const std::array<double, GRID_DIMS>& cellSize = {50.0, 50.0, 5.0},
+                          size_t minPoints = 3);
+        std::string GetName() const override { return "grid"; }
+        ClusteringResult Cluster(const std::vector<float>& points, int dims) override;
+    private:
+        struct Cell {
+            std::array<int64_t, GRID_DIMS> coords;
+            std::vector<size_t> members;
+            size_t neighbourhood = 0;
+            size_t parent = 0;
+        };
+
+        static uint64_t Key(const std::array<int64_t, GRID_DIMS>& coords);
+        size_t Find(size_t cell);
+
+        std::array<double, GRID_DIMS> m_cellSize;
+        size_t m_minPoints;
+        std::vector<Cell> m_cells;
+};
+
+// Picks the grid engine for road-shaped data (a position bounding box much
+// longer than it is wide) and k-means for everything else
+class AutoClusteringEngine : public ClusteringEngine {
+    public:
+        AutoClusteringEngine(int numClusters, double roadAspectRatio = 4.0,
+                             const KMeansOptions& options = KMeansOptions());
+        std::string GetName() const override { return "auto"; }
+        ClusteringResult Cluster(const std::vector<float>& points, int dims) override;
+        void SetBudget(const ClusteringBudget& budget) override { m_kmeans.SetBudget(budget); }
+        const std::string& GetLastChoice() const { return m_lastChoice; }
+    private:
+        KMeansEngine m_kmeans;
+        GridDensityEngine m_grid;
+        double m_roadAspectRatio;
+        std::string m_lastChoice;
+};
+
+// Creates an engine by name: "kmeans", "grid" or "auto". The options go to
+// the k-means of the kmeans and auto engines. Returns nullptr for unknown
+// names.
+inline std::unique_ptr<ClusteringEngine> CreateClusteringEngine(const std::string& name, int numClusters,
+                                                                const KMeansOptions& options = KMeansOptions()) {
+    if (name == "kmeans") {
+        return std::unique_ptr<ClusteringEngine>(new KMeansEngine(numClusters, options));
+    }
+    if (name == "grid") {
+        return std::unique_ptr<ClusteringEngine>(new GridDensityEngine());
+    }
+    if (name == "auto") {
+        return std::unique_ptr<ClusteringEngine>(new AutoClusteringEngine(numClusters, 4.0, options));
+    }
+    return nullptr;
+}
+
+inline KMeansEngine::KMeansEngine(int numClusters, const KMeansOptions& options)
+    : m_numClusters(numClusters),
+      m_options(options)
+{
+}
+
+inline ClusteringResult KMeansEngine::Cluster(const std::vector<float>& points, int dims) {
+    m_stats = KMeansStats();
+    return KMeans(points, dims, m_numClusters, m_options, &m_stats);
+}
+
+inline void KMeansEngine::SetBudget(const ClusteringBudget& budget) {
+    m_options.deadline = budget.deadline;
+    m_options.workBudget = budget.workUnits;
+}
+
+inline GridDensityEngine::GridDensityEngine(const std::array<double, GRID_DIMS>& cellSize, size_t minPoints)
+    : m_cellSize(cellSize),
+      m_minPoints(minPoints)
+{
+}
+
+inline uint64_t GridDensityEngine::Key(const std::array<int64_t, GRID_DIMS>& coords) {
+    // 21 bits per coordinate, enough for +-1e6 cells along every axis
+    uint64_t key = 0;
+    for (int d = 0; d < GRID_DIMS; ++d) {
+        key = (key << 21) | (uint64_t(coords[d] + (1 << 20)) & ((1 << 21) - 1));
+    }
+    return key;
+}
+
+inline size_t GridDensityEngine::Find(size_t cell) {
+    while (m_cells[cell].parent != cell) {
+        m_cells[cell].parent = m_cells[m_cells[cell].parent].parent;
+        cell = m_cells[cell].parent;
+    }
+    return cell;
+}
+
+inline ClusteringResult GridDensityEngine::Cluster(const std::vector<float>& points, int dims) {
+    size_t n = points.size() / dims;
+    int gridDims = std::min(dims, int(GRID_DIMS));
+    m_cells.clear();
+
+    // Hash every point into its cell
+    std::unordered_map<uint64_t, size_t> cellIndex;
+    cellIndex.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        std::array<int64_t, GRID_DIMS> coords = {};
+        for (int d = 0; d < gridDims; ++d) {
+            coords[d] = std::floor(points[i * dims + d] / m_cellSize[d]);
+        }
+        auto inserted = cellIndex.emplace(Key(coords), m_cells.size());
+        if (inserted.second) {
+            m_cells.push_back(Cell{coords, {}, 0, m_cells.size()});
+        }
+        m_cells[inserted.first->second].members.push_back(i);
+    }
+
+    // Visits the occupied cells of the 3^GRID_DIMS neighbourhood of a cell
+    auto forEachNeighbour = [&](const Cell& cell, auto&& visit) {
+        int total = 1;
+        for (int d = 0; d < gridDims; ++d) {
+            total *= 3;
+        }
+        for (int offset = 0; offset < total; ++offset) {
+            std::array<int64_t, GRID_DIMS> coords = cell.coords;
+            int rest = offset;
+            for (int d = 0; d < gridDims; ++d) {
+                coords[d] += rest % 3 - 1;
+                rest /= 3;
+            }
+            auto it = cellIndex.find(Key(coords));
+            if (it != cellIndex.end()) {
+                visit(it->second);
+            }
+        }
+    };
+
+    for (auto& cell : m_cells) {
+        forEachNeighbour(cell, [&](size_t other) {
+            cell.neighbourhood += m_cells[other].members.size();
+        });
+    }
+
+    // Merge neighbouring dense cells
+    auto dense = [&](size_t cell) {
+        return m_cells[cell].neighbourhood >= m_minPoints;
+    };
+    for (size_t c = 0; c < m_cells.size(); ++c) {
+        if (!dense(c)) {
+            continue;
+        }
+        forEachNeighbour(m_cells[c], [&](size_t other) {
+            if (dense(other)) {
+                m_cells[Find(other)].parent = Find(c);
+            }
+        });
+    }
+
+    // Number the clusters in order of first appearance so labels are stable
+    ClusteringResult result;
+    result.dims = dims;
+    result.workUnits = n;
+    result.labels.assign(n, -1);
+    std::vector<int> clusterOfRoot(m_cells.size(), -1);
+    for (size_t c = 0; c < m_cells.size(); ++c) {
+        size_t owner = c;
+        if (!dense(c)) {
+            // Border points follow the first dense neighbour
+            owner = m_cells.size();
+            forEachNeighbour(m_cells[c], [&](size_t other) {
+                if (owner == m_cells.size() && dense(other)) {
+                    owner = other;
+                }
+            });
+            if (owner == m_cells.size()) {
+                continue;
+            }
+        }
+        size_t root = Find(owner);
+        if (clusterOfRoot[root] < 0) {
+            clusterOfRoot[root] = result.numClusters++;
+        }
+        for (size_t i : m_cells[c].members) {
+            result.labels[i] = clusterOfRoot[root];
+        }
+    }
+
+    // Centers are the mean of the members over all features
+    result.centers.assign(size_t(result.numClusters) * dims, 0.0f);
+    std::vector<double> sums(result.centers.size(), 0.0);
+    std::vector<size_t> counts(result.numClusters, 0);
+    for (size_t i = 0; i < n; ++i) {
+        if (result.labels[i] < 0) {
+            continue;
+        }
+        for (int d = 0; d < dims; ++d) {
+            sums[size_t(result.labels[i]) * dims + d] += points[i * dims + d];
+        }
+        ++counts[result.labels[i]];
+    }
+    for (size_t j = 0; j < counts.size(); ++j) {
+        for (int d = 0; d < dims; ++d) {
+            result.centers[j * dims + d] = sums[j * dims + d] / counts[j];
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (result.labels[i] >= 0) {
+            result.inertia += SquaredDistance(&points[i * dims], &result.centers[size_t(result.labels[i]) * dims], dims);
+        }
+    }
+    return result;
+}
+
+inline AutoClusteringEngine::AutoClusteringEngine(int numClusters, double roadAspectRatio,
+                                                  const KMeansOptions& options)
+    : m_kmeans(numClusters, options),
+      m_roadAspectRatio(roadAspectRatio)
+{
+}
+
+inline ClusteringResult AutoClusteringEngine::Cluster(const std::vector<float>& points, int dims) {
+    size_t n = points.size() / dims;
+    bool roadShaped = false;
+    if (dims >= 2 && n > 0) {
+        float minX = points[0], maxX = points[0], minY = points[1], maxY = points[1];
+        for (size_t i = 1; i < n; ++i) {
+            minX = std::min(minX, points[i * dims]);
+            maxX = std::max(maxX, points[i * dims]);
+            minY = std::min(minY, points[i * dims + 1]);
+            maxY = std::max(maxY, points[i * dims + 1]);
+        }
+        double length = std::max(maxX - minX, maxY - minY);
+        double width = std::max(1.0f, std::min(maxX - minX, maxY - minY));
+        roadShaped = length / width >= m_roadAspectRatio;
+    }
+
+    ClusteringEngine& engine = roadShaped ? static_cast<ClusteringEngine&>(m_grid) : m_kmeans;
+    m_lastChoice = engine.GetName();
+    return engine.Cluster(points, dims);
+}
+
+#endif // CLUSTERING_ENGINE_H
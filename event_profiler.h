@@ -0,0 +1,309 @@
+#ifndef EVENT_PROFILER_H
+#define EVENT_PROFILER_H
+
+#include "ns3/core-module.h"
+#include <algorithm>
+#include <chrono>
+#include <cxxabi.h>
+#include <fstream>
+#include <iomanip>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+using namespace ns3;
+
+// Event scheduler that profiles the simulation while delegating the actual
+// queueing to another scheduler (Map, Heap, Calendar or PriorityQueue).
+//
+// The simulator takes events out of the scheduler right before running them,
+// so the wall time between two RemoveNext calls is the time spent running
+// the first event. That time and an event count are attributed to the event
+// source: the type of the scheduled callback (which names the target class,
+// e.g. CAMClient or YansWifiPhy) and the role of the node the event runs on.
+// The queue depth is sampled once per DepthSampleInterval of simulated time.
+class ProfilingScheduler : public Scheduler {
+    public:
+        static TypeId GetTypeId();
+        // The most recently created profiler, null when profiling is off
+        static ProfilingScheduler* GetInstance();
+        // Role names used to attribute events by node context
+        static void SetNodeRole(uint32_t nodeId, const std::string& role);
+
+        ProfilingScheduler();
+        ~ProfilingScheduler() override;
+
+        void Insert(const Event& ev) override;
+        bool IsEmpty() const override;
+        Event PeekNext() const override;
+        Event RemoveNext() override;
+        void Remove(const Event& ev) override;
+
+        void Report(std::ostream& os, size_t maxRows = 30);
+        void WriteDepthSamples(const std::string& path) const;
+
+    protected:
+        void NotifyConstructionCompleted() override;
+
+    private:
+        struct SourceStats {
+            std::string source;
+            std::string role;
+            uint64_t events = 0;
+            double wallSeconds = 0.0;
+        };
+
+        struct DepthSample {
+            Time time;
+            uint64_t depth;
+            uint64_t maxDepth;
+        };
+
+        size_t Classify(const Event& ev);
+        const std::string& SourceName(EventImpl* impl);
+        void CloseCurrent(std::chrono::steady_clock::time_point now);
+
+        static ProfilingScheduler* s_instance;
+        static std::vector<std::string>& NodeRoles();
+
+        std::string m_innerType;
+        Time m_sampleInterval;
+        Ptr<Scheduler> m_inner;
+
+        std::unordered_map<std::type_index, std::string> m_sourceNames;
+        std::unordered_map<std::string, size_t> m_statsIndex;
+        std::vector<SourceStats> m_stats;
+        size_t m_current;
+        std::chrono::steady_clock::time_point m_currentStart;
+
+        uint64_t m_depth;
+        uint64_t m_maxDepth;
+        uint64_t m_nextSample;
+        std::vector<DepthSample> m_depthSamples;
+};
+
+ProfilingScheduler* ProfilingScheduler::s_instance = nullptr;
+
+NS_OBJECT_ENSURE_REGISTERED(ProfilingScheduler);
+
+TypeId ProfilingScheduler::GetTypeId() {
+    static TypeId tid = TypeId("ns3::ProfilingScheduler")
+        .SetParent<Scheduler>()
+        .AddConstructor<ProfilingScheduler>()
+        .AddAttribute("InnerScheduler",
+                      "TypeId name of the scheduler that queues the events",
+                      StringValue("ns3::MapScheduler"),
+                      MakeStringAccessor(&ProfilingScheduler::m_innerType),
+                      MakeStringChecker())
+        .AddAttribute("DepthSampleInterval",
+                      "Simulated time between two queue depth samples",
+                      TimeValue(Seconds(1)),
+                      MakeTimeAccessor(&ProfilingScheduler::m_sampleInterval),
+                      MakeTimeChecker());
+    return tid;
+}
+
+ProfilingScheduler* ProfilingScheduler::GetInstance() {
+    return s_instance;
+}
+
+std::vector<std::string>& ProfilingScheduler::NodeRoles() {
+    static std::vector<std::string> roles;
+    return roles;
+}
+
+void ProfilingScheduler::SetNodeRole(uint32_t nodeId, const std::string& role) {
+    std::vector<std::string>& roles = NodeRoles();
+    if (roles.size() <= nodeId) {
+        roles.resize(nodeId + 1);
+    }
+    roles[nodeId] = role;
+}
+
+ProfilingScheduler::ProfilingScheduler()
+    : m_current(SIZE_MAX),
+      m_depth(0),
+      m_maxDepth(0),
+      m_nextSample(0)
+{
+}
+
+ProfilingScheduler::~ProfilingScheduler() {
+    if (s_instance == this) {
+        s_instance = nullptr;
+    }
+}
+
+void ProfilingScheduler::NotifyConstructionCompleted() {
+    Scheduler::NotifyConstructionCompleted();
+    ObjectFactory factory;
+    factory.SetTypeId(m_innerType);
+    m_inner = factory.Create<Scheduler>();
+    s_instance = this;
+}
+
+void ProfilingScheduler::Insert(const Event& ev) {
+    m_inner->Insert(ev);
+    ++m_depth;
+    m_maxDepth = std::max(m_maxDepth, m_depth);
+}
+
+bool ProfilingScheduler::IsEmpty() const {
+    return m_inner->IsEmpty();
+}
+
+Scheduler::Event ProfilingScheduler::PeekNext() const {
+    return m_inner->PeekNext();
+}
+
+Scheduler::Event ProfilingScheduler::RemoveNext() {
+    auto now = std::chrono::steady_clock::now();
+    CloseCurrent(now);
+
+    Event ev = m_inner->RemoveNext();
+    --m_depth;
+
+    // Sample the depth when simulated time crosses the next sample point
+    if (ev.key.m_ts >= m_nextSample) {
+        m_depthSamples.push_back({TimeStep(ev.key.m_ts), m_depth, m_maxDepth});
+        m_maxDepth = m_depth;
+        uint64_t step = std::max<int64_t>(1, m_sampleInterval.GetTimeStep());
+        m_nextSample = (ev.key.m_ts / step + 1) * step;
+    }
+
+    m_current = Classify(ev);
+    m_currentStart = now;
+    return ev;
+}
+
+void ProfilingScheduler::Remove(const Event& ev) {
+    m_inner->Remove(ev);
+    --m_depth;
+}
+
+void ProfilingScheduler::CloseCurrent(std::chrono::steady_clock::time_point now) {
+    if (m_current != SIZE_MAX) {
+        m_stats[m_current].wallSeconds += std::chrono::duration<double>(now - m_currentStart).count();
+        m_current = SIZE_MAX;
+    }
+}
+
+const std::string& ProfilingScheduler::SourceName(EventImpl* impl) {
+    std::type_index type(typeid(*impl));
+    auto it = m_sourceNames.find(type);
+    if (it != m_sourceNames.end()) {
+        return it->second;
+    }
+
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    std::string name = status == 0 ? demangled : type.name();
+    free(demangled);
+
+    // Member function events carry the target class in the member pointer
+    // type, e.g. "void (ns3::CAMClient::*)()"; keep just that class
+    size_t member = name.find("::*)");
+    if (member != std::string::npos) {
+        size_t start = name.rfind('(', member) + 1;
+        name = name.substr(start, member - start);
+    } else if (name.size() > 100) {
+        name = name.substr(0, 97) + "...";
+    }
+    return m_sourceNames.emplace(type, name).first->second;
+}
+
+size_t ProfilingScheduler::Classify(const Event& ev) {
+    const std::vector<std::string>& roles = NodeRoles();
+    uint32_t context = ev.key.m_context;
+    std::string role = context == Simulator::NO_CONTEXT ? "global"
+                       : (context < roles.size() && !roles[context].empty()) ? roles[context]
+                       : "other";
+    const std::string& source = ev.impl->IsCancelled() ? std::string("(cancelled)") : SourceName(ev.impl);
+
+    std::string key = source + '\t' + role;
+    auto it = m_statsIndex.find(key);
+    if (it == m_statsIndex.end()) {
+        it = m_statsIndex.emplace(key, m_stats.size()).first;
+        m_stats.push_back(SourceStats{source, role, 0, 0.0});
+    }
+    ++m_stats[it->second].events;
+    return it->second;
+}
+
+void ProfilingScheduler::Report(std::ostream& os, size_t maxRows) {
+    CloseCurrent(std::chrono::steady_clock::now());
+
+    std::vector<SourceStats> rows = m_stats;
+    std::sort(rows.begin(), rows.end(), [](const SourceStats& a, const SourceStats& b) {
+        return a.wallSeconds > b.wallSeconds;
+    });
+    double totalWall = 0.0;
+    uint64_t totalEvents = 0;
+    for (const auto& row : rows) {
+        totalWall += row.wallSeconds;
+        totalEvents += row.events;
+    }
+
+    os << "Event profile (" << m_innerType << "): " << totalEvents << " events, " << totalWall << " s" << std::endl;
+    os << "   wall[s]      %     events   us/event  role        source" << std::endl;
+    for (size_t i = 0; i < rows.size() && i < maxRows; ++i) {
+        const SourceStats& row = rows[i];
+        os << std::setw(10) << std::fixed << std::setprecision(3) << row.wallSeconds
+           << std::setw(7) << std::setprecision(1) << (totalWall > 0 ? 100 * row.wallSeconds / totalWall : 0.0)
+           << std::setw(11) << row.events
+           << std::setw(11) << std::setprecision(2) << (row.events ? 1e6 * row.wallSeconds / row.events : 0.0)
+           << "  " << std::left << std::setw(12) << row.role << std::right
+           << row.source << std::endl;
+    }
+    os.unsetf(std::ios::fixed);
+    os << std::setprecision(6);
+
+    uint64_t peak = 0;
+    for (const auto& sample : m_depthSamples) {
+        peak = std::max(peak, sample.maxDepth);
+    }
+    os << "Event queue: peak depth " << peak << " over " << m_depthSamples.size() << " samples" << std::endl;
+}
+
+void ProfilingScheduler::WriteDepthSamples(const std::string& path) const {
+    std::ofstream file(path);
+    file << "time,depth,maxDepth" << std::endl;
+    for (const auto& sample : m_depthSamples) {
+        file << sample.time.GetSeconds() << "," << sample.depth << "," << sample.maxDepth << std::endl;
+    }
+}
+
+// Maps the --scheduler names to ns-3 scheduler types
+std::string SchedulerTypeName(const std::string& name) {
+    if (name == "map") {
+        return "ns3::MapScheduler";
+    }
+    if (name == "heap") {
+        return "ns3::HeapScheduler";
+    }
+    if (name == "calendar") {
+        return "ns3::CalendarScheduler";
+    }
+    if (name == "priority") {
+        return "ns3::PriorityQueueScheduler";
+    }
+    return "";
+}
+
+// Installs the chosen scheduler, wrapped in the profiler when requested.
+// Must run before the first event is scheduled.
+void SetUpScheduler(const std::string& name, bool profile) {
+    std::string type = SchedulerTypeName(name);
+    NS_ABORT_MSG_IF(type.empty(), "Unknown scheduler " << name << " (map, heap, calendar or priority)");
+
+    ObjectFactory factory;
+    if (profile) {
+        factory.SetTypeId("ns3::ProfilingScheduler");
+        factory.Set("InnerScheduler", StringValue(type));
+    } else {
+        factory.SetTypeId(type);
+    }
+    Simulator::SetScheduler(factory);
+}
+
+#endif // EVENT_PROFILER_H
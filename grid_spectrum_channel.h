@@ -0,0 +1,269 @@
+#ifndef GRID_SPECTRUM_CHANNEL_H
+#define GRID_SPECTRUM_CHANNEL_H
+
+#include "ns3/core-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/network-module.h"
+#include "ns3/propagation-module.h"
+#include "ns3/spectrum-module.h"
+#include "ns3/antenna-module.h"
+#include <unordered_map>
+#include <vector>
+
+using namespace ns3;
+
+// Spectrum channel that only delivers a frame to receivers within MaxRange
+// of the transmitter.
+//
+// The stock channels hand every transmission to every PHY on the channel, so
+// the cost of a frame grows with the number of nodes in the simulation even
+// when almost all of them are out of range. Here receivers are kept in a
+// uniform grid of cells keyed by their position; a transmission only visits
+// the 3x3 cells around the sender and, of those, only the receivers closer
+// than MaxRange. The propagation and antenna models then run exactly as in
+// SingleModelSpectrumChannel for the remaining receivers.
+//
+// The grid is rebuilt from the mobility models every RefreshInterval. Cells
+// are MaxRange plus twice the distance a node can travel at MaxSpeed in that
+// interval wide, so a receiver that moved since the last rebuild is still
+// found in the neighbouring cells.
+class GridSpectrumChannel : public SpectrumChannel {
+    public:
+        static TypeId GetTypeId();
+        GridSpectrumChannel();
+
+        void AddRx(Ptr<SpectrumPhy> phy) override;
+        void RemoveRx(Ptr<SpectrumPhy> phy) override;
+        void StartTx(Ptr<SpectrumSignalParameters> params) override;
+
+        std::size_t GetNDevices() const override;
+        Ptr<NetDevice> GetDevice(std::size_t i) const override;
+
+        // Sets MaxRange to the distance at which a transmission at
+        // txPowerDbm drops below rxSensitivityDbm under the channel's
+        // propagation loss model (which must decrease with distance)
+        void SetMaxRangeFromLinkBudget(double txPowerDbm, double rxSensitivityDbm);
+        double GetMaxRange() const { return m_maxRange; }
+
+        // Receptions scheduled so far, for comparing against N per frame
+        uint64_t GetDeliveries() const { return m_deliveries; }
+
+    protected:
+        void DoDispose() override;
+
+    private:
+        static void StartRx(Ptr<SpectrumSignalParameters> params, Ptr<SpectrumPhy> receiver);
+        uint64_t CellKey(int64_t cx, int64_t cy) const;
+        void RebuildGrid();
+
+        std::vector<Ptr<SpectrumPhy>> m_phyList;
+        std::vector<Ptr<SpectrumPhy>> m_unplaced;  // receivers without a mobility model
+        std::unordered_map<uint64_t, std::vector<Ptr<SpectrumPhy>>> m_grid;
+        double m_maxRange;
+        double m_maxSpeed;
+        Time m_refreshInterval;
+        double m_cellSize;
+        Time m_lastRebuild;
+        bool m_dirty;
+        uint64_t m_deliveries;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(GridSpectrumChannel);
+
+TypeId GridSpectrumChannel::GetTypeId() {
+    static TypeId tid = TypeId("ns3::GridSpectrumChannel")
+        .SetParent<SpectrumChannel>()
+        .AddConstructor<GridSpectrumChannel>()
+        .AddAttribute("MaxRange",
+                      "Receivers further than this many metres from the sender are skipped",
+                      DoubleValue(1000.0),
+                      MakeDoubleAccessor(&GridSpectrumChannel::m_maxRange),
+                      MakeDoubleChecker<double>(0.0))
+        .AddAttribute("MaxSpeed",
+                      "Highest node speed in m/s, used to size the grid cells",
+                      DoubleValue(50.0),
+                      MakeDoubleAccessor(&GridSpectrumChannel::m_maxSpeed),
+                      MakeDoubleChecker<double>(0.0))
+        .AddAttribute("RefreshInterval",
+                      "Simulated time between two rebuilds of the receiver grid",
+                      TimeValue(MilliSeconds(500)),
+                      MakeTimeAccessor(&GridSpectrumChannel::m_refreshInterval),
+                      MakeTimeChecker());
+    return tid;
+}
+
+GridSpectrumChannel::GridSpectrumChannel()
+    : m_cellSize(0.0),
+      m_dirty(true),
+      m_deliveries(0)
+{
+}
+
+void GridSpectrumChannel::DoDispose() {
+    m_phyList.clear();
+    m_unplaced.clear();
+    m_grid.clear();
+    SpectrumChannel::DoDispose();
+}
+
+void GridSpectrumChannel::AddRx(Ptr<SpectrumPhy> phy) {
+    m_phyList.push_back(phy);
+    m_dirty = true;
+}
+
+void GridSpectrumChannel::RemoveRx(Ptr<SpectrumPhy> phy) {
+    auto it = std::find(m_phyList.begin(), m_phyList.end(), phy);
+    if (it != m_phyList.end()) {
+        m_phyList.erase(it);
+        m_dirty = true;
+    }
+}
+
+std::size_t GridSpectrumChannel::GetNDevices() const {
+    return m_phyList.size();
+}
+
+Ptr<NetDevice> GridSpectrumChannel::GetDevice(std::size_t i) const {
+    return m_phyList.at(i)->GetDevice();
+}
+
+void GridSpectrumChannel::SetMaxRangeFromLinkBudget(double txPowerDbm, double rxSensitivityDbm) {
+    NS_ABORT_MSG_IF(!m_propagationLoss, "Add a propagation loss model before deriving the range");
+    Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel>();
+    Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel>();
+    a->SetPosition(Vector(0.0, 0.0, 0.0));
+
+    // Bisection on the distance where the received power hits the threshold
+    double low = 1.0;
+    double high = 1e6;
+    for (int i = 0; i < 60; ++i) {
+        double mid = (low + high) / 2;
+        b->SetPosition(Vector(mid, 0.0, 0.0));
+        if (m_propagationLoss->CalcRxPower(txPowerDbm, a, b) >= rxSensitivityDbm) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    m_maxRange = high;
+    m_dirty = true;
+}
+
+uint64_t GridSpectrumChannel::CellKey(int64_t cx, int64_t cy) const {
+    return (uint64_t(cx) << 32) ^ (uint64_t(cy) & 0xffffffff);
+}
+
+void GridSpectrumChannel::RebuildGrid() {
+    m_cellSize = m_maxRange + 2 * m_maxSpeed * m_refreshInterval.GetSeconds();
+    m_grid.clear();
+    m_unplaced.clear();
+    for (const auto& phy : m_phyList) {
+        Ptr<MobilityModel> mobility = phy->GetMobility();
+        if (!mobility) {
+            m_unplaced.push_back(phy);
+            continue;
+        }
+        Vector position = mobility->GetPosition();
+        m_grid[CellKey(std::floor(position.x / m_cellSize), std::floor(position.y / m_cellSize))].push_back(phy);
+    }
+    m_lastRebuild = Simulator::Now();
+    m_dirty = false;
+}
+
+void GridSpectrumChannel::StartRx(Ptr<SpectrumSignalParameters> params, Ptr<SpectrumPhy> receiver) {
+    receiver->StartRx(params);
+}
+
+void GridSpectrumChannel::StartTx(Ptr<SpectrumSignalParameters> txParams) {
+    NS_ASSERT_MSG(txParams->psd, "NULL txPsd");
+    NS_ASSERT_MSG(txParams->txPhy, "NULL txPhy");
+    m_txSigParamsTrace(txParams->Copy());
+
+    if (m_dirty || Simulator::Now() - m_lastRebuild >= m_refreshInterval) {
+        RebuildGrid();
+    }
+
+    Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility();
+    Ptr<NetDevice> txNetDevice = txParams->txPhy->GetDevice();
+
+    auto deliver = [&](const Ptr<SpectrumPhy>& rxPhy) {
+        if (rxPhy == txParams->txPhy) {
+            return;
+        }
+        Ptr<NetDevice> rxNetDevice = rxPhy->GetDevice();
+        if (rxNetDevice && txNetDevice && rxNetDevice->GetNode()->GetId() == txNetDevice->GetNode()->GetId()) {
+            return;
+        }
+
+        Time delay = MicroSeconds(0);
+        Ptr<MobilityModel> receiverMobility = rxPhy->GetMobility();
+        if (senderMobility && receiverMobility
+            && senderMobility->GetDistanceFrom(receiverMobility) > m_maxRange) {
+            return;
+        }
+
+        Ptr<SpectrumSignalParameters> rxParams = txParams->Copy();
+        if (senderMobility && receiverMobility) {
+            double pathLossDb = 0;
+            if (rxParams->txAntenna) {
+                Angles txAngles(receiverMobility->GetPosition(), senderMobility->GetPosition());
+                pathLossDb -= rxParams->txAntenna->GetGainDb(txAngles);
+            }
+            Ptr<AntennaModel> rxAntenna = DynamicCast<AntennaModel>(rxPhy->GetAntenna());
+            if (rxAntenna) {
+                Angles rxAngles(senderMobility->GetPosition(), receiverMobility->GetPosition());
+                pathLossDb -= rxAntenna->GetGainDb(rxAngles);
+            }
+            if (m_propagationLoss) {
+                pathLossDb -= m_propagationLoss->CalcRxPower(0, senderMobility, receiverMobility);
+            }
+            m_pathLossTrace(txParams->txPhy, rxPhy, pathLossDb);
+            if (pathLossDb > m_maxLossDb) {
+                return;
+            }
+            *(rxParams->psd) *= std::pow(10.0, -pathLossDb / 10.0);
+            if (m_spectrumPropagationLoss) {
+                rxParams->psd = m_spectrumPropagationLoss->CalcRxPowerSpectralDensity(rxParams, senderMobility, receiverMobility);
+            }
+            if (m_propagationDelay) {
+                delay = m_propagationDelay->GetDelay(senderMobility, receiverMobility);
+            }
+        }
+
+        ++m_deliveries;
+        if (rxNetDevice) {
+            Simulator::ScheduleWithContext(rxNetDevice->GetNode()->GetId(), delay,
+                                           &GridSpectrumChannel::StartRx, rxParams, rxPhy);
+        } else {
+            Simulator::Schedule(delay, &GridSpectrumChannel::StartRx, rxParams, rxPhy);
+        }
+    };
+
+    if (!senderMobility) {
+        // Without a position the sender reaches everyone, as on the stock channels
+        for (const auto& rxPhy : m_phyList) {
+            deliver(rxPhy);
+        }
+        return;
+    }
+
+    Vector position = senderMobility->GetPosition();
+    int64_t cx = std::floor(position.x / m_cellSize);
+    int64_t cy = std::floor(position.y / m_cellSize);
+    for (int64_t dx = -1; dx <= 1; ++dx) {
+        for (int64_t dy = -1; dy <= 1; ++dy) {
+            auto cell = m_grid.find(CellKey(cx + dx, cy + dy));
+            if (cell == m_grid.end()) {
+                continue;
+            }
+            for (const auto& rxPhy : cell->second) {
+                deliver(rxPhy);
+            }
+        }
+    }
+    for (const auto& rxPhy : m_unplaced) {
+        deliver(rxPhy);
+    }
+}
+
+#endif // GRID_SPECTRUM_CHANNEL_H
@@ -0,0 +1,451 @@
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// k-means with Hamerly's bounds.
+//
+// Every point keeps an upper bound on the distance to its own center and a
+// lower bound on the distance to any other center. As long as the upper bound
+// is below both the lower bound and half the distance from its center to the
+// nearest other center, the assignment cannot change and no distance needs to
+// be computed for that point. Once the centers settle, most iterations only
+// touch the bounds. Restarts are independent and run on separate threads; the
+// result with the lowest inertia wins, ties going to the earliest restart, so
+// the outcome does not depend on thread scheduling.
+//
+// The run is anytime: with a wall-clock deadline or a budget of distance
+// evaluations it stops where it is when the budget runs out and returns the
+// best assignment found so far. Centers only ever improve the inertia, so the
+// partial result is a valid, if coarser, clustering. The budget is checked in
+// the seeding too: centers the seeding had no budget for are random points.
+// The first assignment pass always completes, so every point gets a label
+// and the inertias of the restarts stay comparable; a run can therefore
+// overshoot its budget by one pass of n * k distances.
+//
+// The run is instantiated per feature dimension: for the common dimensions
+// the distance loops have a compile-time trip count and are fully unrolled,
+// other dimensions fall back to the runtime loop.
+
+struct ClusteringResult {
+    int numClusters = 0;
+    int dims = 0;
+    std::vector<int> labels;     // one label per input point
+    std::vector<float> centers;  // numClusters x dims, row major
+    double inertia = 0.0;        // sum of squared distances to the centers
+    bool converged = true;       // false when a deadline cut the run short
+    // Estimated relative inertia still to gain: the share of the inertia the
+    // last center update removed, 0 once converged, infinity when the run was
+    // cut short before any center update
+    double inertiaGap = 0.0;
+    // Work on the longest running thread (distance evaluations for k-means,
+    // point visits for single-pass engines), used to model compute latency
+    uint64_t workUnits = 0;
+
+    float Center(int cluster, int dim) const {
+        return centers[cluster * dims + dim];
+    }
+};
+
+struct KMeansOptions {
+    int maxIterations = 10;
+    double epsilon = 1.0;   // converged once no center moves further than this
+    int attempts = 3;
+    uint64_t seed = 0x5eed;
+    unsigned threads = 0;   // threads for the restarts, 0 runs one per attempt
+
+    // Anytime limits, zero disables them
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    uint64_t workBudget = 0;  // distance evaluations per thread, seeding included
+};
+
+struct KMeansStats {
+    uint64_t distanceEvaluations = 0; // point-to-center distances computed
+    uint64_t iterations = 0;          // assignment passes, summed over all attempts
+    uint64_t numPoints = 0;
+    int numClusters = 0;
+
+    // Average share of the n*k point-to-center distances a plain Lloyd
+    // iteration computes that were actually evaluated
+    double EvaluatedFraction() const {
+        uint64_t naive = iterations * numPoints * numClusters;
+        return naive ? double(distanceEvaluations) / naive : 0.0;
+    }
+};
+
+inline double SquaredDistance(const float* a, const float* b, int dims) {
+    double sum = 0.0;
+    for (int d = 0; d < dims; ++d) {
+        double diff = double(a[d]) - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+template <int... I>
+inline double UnrolledSquaredDistance(const float* a, const float* b, std::integer_sequence<int, I...>) {
+    return (0.0 + ... + ((double(a[I]) - b[I]) * (double(a[I]) - b[I])));
+}
+
+// Squared distance with the dimension fixed at compile time, D = 0 uses dims
+template <int D>
+inline double SquaredDistanceN(const float* a, const float* b, int dims) {
+    if constexpr (D == 0) {
+        return SquaredDistance(a, b, dims);
+    } else {
+        return UnrolledSquaredDistance(a, b, std::make_integer_sequence<int, D>());
+    }
+}
+
+// One k-means run from a k-means++ seeding, D is the compile-time dimension
+// (0 takes it from the constructor)
+template <int D>
+class HamerlyKMeans {
+    public:
+        HamerlyKMeans(const std::vector<float>& points, int dims, int k, const KMeansOptions& options);
+        ClusteringResult Run(uint64_t seed);
+        uint64_t GetDistanceEvaluations() const { return m_distanceEvaluations; }
+        uint64_t GetIterations() const { return m_iterations; }
+        uint64_t GetWork() const { return m_seedEvaluations + m_distanceEvaluations; }
+        void SetWorkBudget(uint64_t budget) { m_workBudget = budget; }
+    private:
+        int Dims() const { return D ? D : m_dims; }
+        const float* Point(size_t i) const { return m_points.data() + i * Dims(); }
+        float* Center(int j) { return m_centers.data() + j * Dims(); }
+        double Distance(size_t i, int j);
+        void SeedCenters(std::mt19937_64& rng);
+        void AssignAll(size_t i);
+        bool UpdateCenters();
+        bool OutOfBudget() const;
+
+        const std::vector<float>& m_points;
+        int m_dims;
+        int m_k;
+        size_t m_n;
+        KMeansOptions m_options;
+        std::vector<float> m_centers;
+        std::vector<int> m_labels;
+        std::vector<double> m_upper;
+        std::vector<double> m_lower;
+        std::vector<double> m_halfGap;  // half distance to the nearest other center
+        std::vector<double> m_moved;
+        double m_lastGain = 0.0;  // inertia removed by the last center update
+        uint64_t m_workBudget = 0;
+        uint64_t m_seedEvaluations = 0;
+        uint64_t m_distanceEvaluations = 0;
+        uint64_t m_iterations = 0;
+};
+
+template <int D>
+inline HamerlyKMeans<D>::HamerlyKMeans(const std::vector<float>& points, int dims, int k, const KMeansOptions& options)
+    : m_points(points),
+      m_dims(dims),
+      m_k(k),
+      m_n(points.size() / dims),
+      m_options(options),
+      m_workBudget(options.workBudget)
+{
+}
+
+template <int D>
+inline bool HamerlyKMeans<D>::OutOfBudget() const {
+    if (m_workBudget && GetWork() >= m_workBudget) {
+        return true;
+    }
+    return m_options.deadline != std::chrono::steady_clock::time_point::max()
+           && std::chrono::steady_clock::now() >= m_options.deadline;
+}
+
+template <int D>
+inline double HamerlyKMeans<D>::Distance(size_t i, int j) {
+    ++m_distanceEvaluations;
+    return std::sqrt(SquaredDistanceN<D>(Point(i), Center(j), Dims()));
+}
+
+template <int D>
+inline void HamerlyKMeans<D>::SeedCenters(std::mt19937_64& rng) {
+    // k-means++: every next center is drawn proportionally to the squared
+    // distance to the closest center picked so far
+    m_centers.assign(size_t(m_k) * Dims(), 0.0f);
+    std::vector<double> closest(m_n, std::numeric_limits<double>::max());
+    size_t first = std::uniform_int_distribution<size_t>(0, m_n - 1)(rng);
+    std::copy(Point(first), Point(first) + Dims(), Center(0));
+
+    for (int j = 1; j < m_k; ++j) {
+        double total = 0.0;
+        bool interrupted = false;
+        for (size_t i = 0; i < m_n; ++i) {
+            if ((i & 1023) == 0 && OutOfBudget()) {
+                interrupted = true;
+                break;
+            }
+            closest[i] = std::min(closest[i], SquaredDistanceN<D>(Point(i), Center(j - 1), Dims()));
+            total += closest[i];
+            ++m_seedEvaluations;
+        }
+        if (interrupted) {
+            // No budget left to weigh the points, the rest are drawn uniformly
+            for (; j < m_k; ++j) {
+                size_t pick = std::uniform_int_distribution<size_t>(0, m_n - 1)(rng);
+                std::copy(Point(pick), Point(pick) + Dims(), Center(j));
+            }
+            break;
+        }
+        size_t pick = m_n - 1;
+        double target = std::uniform_real_distribution<double>(0.0, total)(rng);
+        for (size_t i = 0; i < m_n; ++i) {
+            target -= closest[i];
+            if (target <= 0.0) {
+                pick = i;
+                break;
+            }
+        }
+        std::copy(Point(pick), Point(pick) + Dims(), Center(j));
+    }
+}
+
+template <int D>
+inline void HamerlyKMeans<D>::AssignAll(size_t i) {
+    double best = std::numeric_limits<double>::max();
+    double second = std::numeric_limits<double>::max();
+    int label = 0;
+    for (int j = 0; j < m_k; ++j) {
+        double distance = Distance(i, j);
+        if (distance < best) {
+            second = best;
+            best = distance;
+            label = j;
+        } else if (distance < second) {
+            second = distance;
+        }
+    }
+    m_labels[i] = label;
+    m_upper[i] = best;
+    m_lower[i] = second;
+}
+
+template <int D>
+inline bool HamerlyKMeans<D>::UpdateCenters() {
+    std::vector<double> sums(size_t(m_k) * Dims(), 0.0);
+    std::vector<size_t> counts(m_k, 0);
+    for (size_t i = 0; i < m_n; ++i) {
+        double* sum = sums.data() + size_t(m_labels[i]) * Dims();
+        for (int d = 0; d < Dims(); ++d) {
+            sum[d] += Point(i)[d];
+        }
+        ++counts[m_labels[i]];
+    }
+
+    // Empty clusters keep their previous center. Moving a center to the mean
+    // of its points lowers the inertia by count * moved^2.
+    double maxMoved = 0.0;
+    m_lastGain = 0.0;
+    for (int j = 0; j < m_k; ++j) {
+        m_moved[j] = 0.0;
+        if (!counts[j]) {
+            continue;
+        }
+        std::vector<float> previous(Center(j), Center(j) + Dims());
+        for (int d = 0; d < Dims(); ++d) {
+            Center(j)[d] = sums[size_t(j) * Dims() + d] / counts[j];
+        }
+        m_moved[j] = std::sqrt(SquaredDistanceN<D>(previous.data(), Center(j), Dims()));
+        m_lastGain += counts[j] * m_moved[j] * m_moved[j];
+        maxMoved = std::max(maxMoved, m_moved[j]);
+    }
+
+    // Shift the bounds by how far the centers moved
+    int farthest = std::max_element(m_moved.begin(), m_moved.end()) - m_moved.begin();
+    double secondMoved = 0.0;
+    for (int j = 0; j < m_k; ++j) {
+        if (j != farthest) {
+            secondMoved = std::max(secondMoved, m_moved[j]);
+        }
+    }
+    for (size_t i = 0; i < m_n; ++i) {
+        m_upper[i] += m_moved[m_labels[i]];
+        m_lower[i] -= m_labels[i] == farthest ? secondMoved : m_moved[farthest];
+    }
+
+    return maxMoved <= m_options.epsilon;
+}
+
+template <int D>
+inline ClusteringResult HamerlyKMeans<D>::Run(uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    SeedCenters(rng);
+
+    m_labels.assign(m_n, 0);
+    m_upper.assign(m_n, 0.0);
+    m_lower.assign(m_n, 0.0);
+    m_halfGap.assign(m_k, 0.0);
+    m_moved.assign(m_k, 0.0);
+    // Not interruptible: without it the points have no label at all
+    for (size_t i = 0; i < m_n; ++i) {
+        AssignAll(i);
+    }
+    ++m_iterations;
+    bool interrupted = OutOfBudget();
+
+    bool converged = false;
+    for (int iteration = 0; iteration < m_options.maxIterations && !interrupted; ++iteration) {
+        if (UpdateCenters()) {
+            converged = true;
+            break;
+        }
+        if (OutOfBudget()) {
+            interrupted = true;
+            break;
+        }
+        ++m_iterations;
+
+        for (int j = 0; j < m_k; ++j) {
+            double nearest = std::numeric_limits<double>::max();
+            for (int other = 0; other < m_k; ++other) {
+                if (other != j) {
+                    nearest = std::min(nearest, std::sqrt(SquaredDistanceN<D>(Center(j), Center(other), Dims())));
+                }
+            }
+            m_halfGap[j] = nearest / 2;
+        }
+
+        for (size_t i = 0; i < m_n; ++i) {
+            // Points not visited keep valid (if loose) bounds, so the pass can
+            // stop anywhere
+            if ((i & 1023) == 0 && OutOfBudget()) {
+                interrupted = true;
+                break;
+            }
+            double bound = std::max(m_halfGap[m_labels[i]], m_lower[i]);
+            if (m_upper[i] <= bound) {
+                continue;
+            }
+            // Tighten the upper bound before paying for all k distances
+            m_upper[i] = Distance(i, m_labels[i]);
+            if (m_upper[i] <= bound) {
+                continue;
+            }
+            AssignAll(i);
+        }
+    }
+
+    ClusteringResult result;
+    result.numClusters = m_k;
+    result.dims = Dims();
+    result.labels = m_labels;
+    result.centers = m_centers;
+    for (size_t i = 0; i < m_n; ++i) {
+        result.inertia += SquaredDistanceN<D>(Point(i), Center(m_labels[i]), Dims());
+    }
+    // Running out of iterations is not an interruption, the caller asked for it
+    result.converged = !interrupted;
+    if (converged) {
+        result.inertiaGap = 0.0;
+    } else if (m_lastGain > 0.0 && result.inertia > 0.0) {
+        result.inertiaGap = m_lastGain / result.inertia;
+    } else if (interrupted) {
+        result.inertiaGap = std::numeric_limits<double>::infinity();
+    }
+    result.workUnits = GetWork();
+    return result;
+}
+
+// Runs options.attempts restarts concurrently and returns the best one
+template <int D>
+inline ClusteringResult KMeansFixed(const std::vector<float>& points, int dims, int k,
+                                    const KMeansOptions& options, KMeansStats* stats) {
+    size_t n = points.size() / dims;
+    k = std::min<size_t>(k, n);
+    if (k <= 0) {
+        ClusteringResult empty;
+        empty.dims = dims;
+        return empty;
+    }
+
+    int attempts = std::max(1, options.attempts);
+    unsigned numThreads = options.threads ? options.threads : attempts;
+    numThreads = std::min<unsigned>(numThreads, attempts);
+
+    std::vector<ClusteringResult> results(attempts);
+    // Not vector<bool>: the threads write neighbouring flags concurrently
+    std::vector<char> ran(attempts, 0);
+    std::vector<uint64_t> evaluations(attempts, 0);
+    std::vector<uint64_t> iterations(attempts, 0);
+    std::vector<uint64_t> threadWork(numThreads, 0);
+    auto runAttempts = [&](unsigned worker) {
+        for (int attempt = worker; attempt < attempts; attempt += numThreads) {
+            // The first attempt of every thread always runs so there is a
+            // result to return; later ones only start with budget left
+            HamerlyKMeans<D> run(points, dims, k, options);
+            if (options.workBudget) {
+                if (threadWork[worker] >= options.workBudget) {
+                    break;
+                }
+                run.SetWorkBudget(options.workBudget - threadWork[worker]);
+            }
+            if (attempt >= int(numThreads) && std::chrono::steady_clock::now() >= options.deadline) {
+                break;
+            }
+            results[attempt] = run.Run(options.seed + attempt);
+            ran[attempt] = 1;
+            evaluations[attempt] = run.GetDistanceEvaluations();
+            iterations[attempt] = run.GetIterations();
+            threadWork[worker] += run.GetWork();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < numThreads; ++t) {
+        workers.emplace_back(runAttempts, t);
+    }
+    runAttempts(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    // Every restart that ran labelled all points, so the inertias compare
+    int best = 0;
+    for (int attempt = 1; attempt < attempts; ++attempt) {
+        if (ran[attempt] && results[attempt].inertia < results[best].inertia) {
+            best = attempt;
+        }
+    }
+    results[best].workUnits = *std::max_element(threadWork.begin(), threadWork.end());
+
+    if (stats) {
+        stats->numPoints = n;
+        stats->numClusters = k;
+        for (int attempt = 0; attempt < attempts; ++attempt) {
+            stats->distanceEvaluations += evaluations[attempt];
+            stats->iterations += iterations[attempt];
+        }
+    }
+    return results[best];
+}
+
+// k-means on numPoints x dims row-major points, dispatched to the kernel
+// specialized for dims
+inline ClusteringResult KMeans(const std::vector<float>& points, int dims, int k,
+                               const KMeansOptions& options, KMeansStats* stats = nullptr) {
+    switch (dims) {
+        case 1: return KMeansFixed<1>(points, dims, k, options, stats);
+        case 2: return KMeansFixed<2>(points, dims, k, options, stats);
+        case 3: return KMeansFixed<3>(points, dims, k, options, stats);
+        case 4: return KMeansFixed<4>(points, dims, k, options, stats);
+        case 5: return KMeansFixed<5>(points, dims, k, options, stats);
+        case 6: return KMeansFixed<6>(points, dims, k, options, stats);
+        case 7: return KMeansFixed<7>(points, dims, k, options, stats);
+        case 8: return KMeansFixed<8>(points, dims, k, options, stats);
+        default: return KMeansFixed<0>(points, dims, k, options, stats);
+    }
+}
+
+#endif // KMEANS_H
@@ -0,0 +1,205 @@
+#ifndef MOTION_PREDICTOR_H
+#define MOTION_PREDICTOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <vector>
+#include "cam_clustering.h"
+
+// Per-vehicle motion tracking for predictive clustering at the RSU.
+//
+// Every vehicle gets a constant-velocity alpha-beta filter (a steady-state
+// Kalman filter for that motion model) fed with the positions of its CAMs.
+// The RSU extrapolates the tracks to the epoch time and, as long as the CAMs
+// keep landing within a tolerance of the predictions, moves the previous
+// clusters along with their members instead of clustering again. The
+// updates sent to the controller carry the velocity of every cluster, and
+// CenterDrift tells when the controller's extrapolation has drifted too far.
+// Nothing in here depends on ns-3.
+
+struct VehicleTrack {
+    double time = 0.0;   // time of the last CAM
+    double posX = 0.0;   // filtered position at that time
+    double posY = 0.0;
+    double velX = 0.0;
+    double velY = 0.0;
+    CAMData last = {};   // the last CAM, for the fields that are not predicted
+    bool hasVelocity = false;
+};
+
+class MotionPredictor {
+    public:
+        // alpha and beta are the position and velocity gains of the filter
+        explicit MotionPredictor(double alpha = 0.85, double beta = 0.5)
+            : m_alpha(alpha), m_beta(beta) {}
+
+        // Updates the track of the CAM's vehicle and returns how far, in
+        // metres, the CAM was from the predicted position. Vehicles without a
+        // velocity estimate yet (their first two CAMs) return 0.
+        double Observe(const CAMData& cam, double time) {
+            auto it = m_tracks.find(cam.id);
+            if (it == m_tracks.end()) {
+                VehicleTrack& track = m_tracks[cam.id];
+                track.time = time;
+                track.posX = cam.posX;
+                track.posY = cam.posY;
+                track.last = cam;
+                return 0.0;
+            }
+
+            VehicleTrack& track = it->second;
+            double dt = time - track.time;
+            if (dt <= 0.0) {
+                return 0.0;
+            }
+            track.last = cam;
+            if (!track.hasVelocity) {
+                track.velX = (cam.posX - track.posX) / dt;
+                track.velY = (cam.posY - track.posY) / dt;
+                track.posX = cam.posX;
+                track.posY = cam.posY;
+                track.time = time;
+                track.hasVelocity = true;
+                return 0.0;
+            }
+
+            double predX = track.posX + track.velX * dt;
+            double predY = track.posY + track.velY * dt;
+            double residualX = cam.posX - predX;
+            double residualY = cam.posY - predY;
+            track.posX = predX + m_alpha * residualX;
+            track.posY = predY + m_alpha * residualY;
+            track.velX += m_beta * residualX / dt;
+            track.velY += m_beta * residualY / dt;
+            track.time = time;
+            return std::sqrt(residualX * residualX + residualY * residualY);
+        }
+
+        // The vehicle's CAM extrapolated to the given time
+        CAMData Predict(uint32_t id, double time) const {
+            const VehicleTrack& track = m_tracks.at(id);
+            double dt = time - track.time;
+            CAMData cam = track.last;
+            cam.posX = track.posX + track.velX * dt;
+            cam.posY = track.posY + track.velY * dt;
+            return cam;
+        }
+
+        // Drops the vehicles whose last CAM is older than the given time and
+        // returns how many were dropped
+        size_t Forget(double olderThan) {
+            size_t dropped = 0;
+            for (auto it = m_tracks.begin(); it != m_tracks.end();) {
+                if (it->second.time < olderThan) {
+                    it = m_tracks.erase(it);
+                    ++dropped;
+                } else {
+                    ++it;
+                }
+            }
+            return dropped;
+        }
+
+        const std::map<uint32_t, VehicleTrack>& GetTracks() const { return m_tracks; }
+
+    private:
+        double m_alpha;
+        double m_beta;
+        std::map<uint32_t, VehicleTrack> m_tracks;
+};
+
+// Carries a previous clustering over to new positions of the same vehicles:
+// every vehicle keeps its label and the centers move to the mean of their
+// members. Clusters that lost all their members keep their old center.
+inline ClusteringResult PredictClusters(const ClusteringResult& previous, const std::vector<CAMData>& cams,
+                                        const std::vector<int>& labels) {
+    ClusteringResult result;
+    result.numClusters = previous.numClusters;
+    result.dims = previous.dims;
+    result.labels = labels;
+    result.centers = previous.centers;
+    result.converged = previous.converged;
+    result.inertiaGap = previous.inertiaGap;
+    result.workUnits = cams.size();
+
+    std::vector<float> points = PackCAMData(cams);
+    std::vector<double> sums(result.centers.size(), 0.0);
+    std::vector<size_t> counts(result.numClusters, 0);
+    for (size_t i = 0; i < cams.size(); ++i) {
+        if (labels[i] < 0) {
+            continue;
+        }
+        for (int d = 0; d < result.dims; ++d) {
+            sums[labels[i] * result.dims + d] += points[i * result.dims + d];
+        }
+        ++counts[labels[i]];
+    }
+    for (int c = 0; c < result.numClusters; ++c) {
+        if (counts[c] == 0) {
+            continue;
+        }
+        for (int d = 0; d < result.dims; ++d) {
+            result.centers[c * result.dims + d] = sums[c * result.dims + d] / counts[c];
+        }
+    }
+
+    for (size_t i = 0; i < cams.size(); ++i) {
+        if (labels[i] >= 0) {
+            result.inertia += SquaredDistance(&points[i * result.dims], &result.centers[labels[i] * result.dims],
+                                              result.dims);
+        }
+    }
+    return result;
+}
+
+// Velocity of every cluster, the mean velocity of the tracks of its members,
+// as velX, velY per cluster. Members without a track count as standing still.
+inline std::vector<float> ClusterVelocities(const MotionPredictor& predictor, const std::vector<CAMData>& cams,
+                                            const ClusteringResult& result) {
+    std::vector<double> sums(size_t(result.numClusters) * 2, 0.0);
+    std::vector<size_t> counts(result.numClusters, 0);
+    for (size_t i = 0; i < cams.size(); ++i) {
+        int label = result.labels[i];
+        if (label < 0) {
+            continue;
+        }
+        auto track = predictor.GetTracks().find(cams[i].id);
+        if (track != predictor.GetTracks().end()) {
+            sums[label * 2] += track->second.velX;
+            sums[label * 2 + 1] += track->second.velY;
+        }
+        ++counts[label];
+    }
+    std::vector<float> velocities(sums.size(), 0.0f);
+    for (int c = 0; c < result.numClusters; ++c) {
+        if (counts[c]) {
+            velocities[c * 2] = sums[c * 2] / counts[c];
+            velocities[c * 2 + 1] = sums[c * 2 + 1] / counts[c];
+        }
+    }
+    return velocities;
+}
+
+// Largest distance, in metres, between the position of a center and where a
+// receiver moves the last centers it got along their velocities after dt
+// seconds. The position is the first two features of the centers. A
+// different number of clusters is an infinite drift.
+inline double CenterDrift(const ClusteringResult& result, const std::vector<float>& sentCenters,
+                          const std::vector<float>& sentVelocities, double dt) {
+    if (sentCenters.size() != result.centers.size() || sentVelocities.size() != size_t(result.numClusters) * 2
+        || result.dims < 2) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double drift = 0.0;
+    for (int c = 0; c < result.numClusters; ++c) {
+        double expectedX = sentCenters[c * result.dims] + sentVelocities[c * 2] * dt;
+        double expectedY = sentCenters[c * result.dims + 1] + sentVelocities[c * 2 + 1] * dt;
+        drift = std::max(drift, std::hypot(result.Center(c, 0) - expectedX, result.Center(c, 1) - expectedY));
+    }
+    return drift;
+}
+
+#endif // MOTION_PREDICTOR_H
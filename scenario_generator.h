@@ -0,0 +1,248 @@
+#ifndef SCENARIO_GENERATOR_H
+#define SCENARIO_GENERATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Reproducible road scenarios for load testing.
+//
+// A scenario is a list of vehicles moving at constant velocity and a list of
+// RSU positions. Vehicles entering later are placed upstream of the road
+// entry so that a constant velocity model started at t=0 reaches the entry
+// exactly at entryTime; exitTime is when they leave the road. Everything is
+// drawn from one seeded generator, so the same configuration always yields
+// the same scenario. No ns-3 dependency, main turns the specs into nodes.
+//
+//   platoon  one lane, vehicles carSpacing apart at 20 m/s, numRSUs RSUs
+//            spread over the platoon (the original scenario)
+//   highway  straight road along x, lanesPerDirection lanes each way
+//   grid     Manhattan grid of gridRows x gridCols blocks of blockLength,
+//            two-way streets with lanesPerDirection lanes each way
+
+struct VehicleSpec {
+    double x;
+    double y;
+    double vx;
+    double vy;
+    double entryTime;
+    double exitTime;
+    uint32_t lane = 0;  // lane index in the direction of travel, 0 is next to the centre line
+};
+
+struct RsuSpec {
+    double x;
+    double y;
+};
+
+struct ScenarioConfig {
+    std::string type = "platoon";
+    uint32_t numVehicles = 50;   // vehicles on the road at t=0
+    uint64_t seed = 1;
+    double simTime = 60.0;
+
+    // platoon
+    double carSpacing = 9.0;
+    uint32_t numRSUs = 4;
+
+    // highway and grid
+    uint32_t lanesPerDirection = 2;
+    double laneWidth = 3.5;
+    double roadLength = 5000.0;
+    uint32_t gridRows = 5;
+    uint32_t gridCols = 5;
+    double blockLength = 200.0;
+
+    // per-vehicle speed, normal distribution clipped to [minSpeed, maxSpeed]
+    double speedMean = 25.0;
+    double speedStdDev = 4.0;
+    double minSpeed = 5.0;
+    double maxSpeed = 40.0;
+
+    // Poisson arrivals per road entry point in vehicles per second
+    double entryRate = 0.0;
+
+    // RSUs per km of road, placed rsuOffset metres beside the road
+    double rsuDensity = 2.0;
+    double rsuOffset = 20.0;
+};
+
+struct Scenario {
+    std::vector<VehicleSpec> vehicles;
+    std::vector<RsuSpec> rsus;
+};
+
+// A straight directed stretch of road: from (x0, y0) along the unit vector
+// (dx, dy) for length metres
+struct RoadLane {
+    double x0;
+    double y0;
+    double dx;
+    double dy;
+    double length;
+    uint32_t lane;
+};
+
+class ScenarioGenerator {
+    public:
+        explicit ScenarioGenerator(const ScenarioConfig& config);
+        Scenario Generate();
+    private:
+        void GeneratePlatoon(Scenario& scenario);
+        void GenerateLanes(Scenario& scenario, const std::vector<RoadLane>& lanes);
+        void PlaceRsusAlong(Scenario& scenario, double x0, double y0, double dx, double dy, double length);
+        double DrawSpeed();
+
+        ScenarioConfig m_config;
+        std::mt19937_64 m_rng;
+        // RSUs closer than this are merged into one
+        static constexpr double RSU_MERGE_DISTANCE = 1.0;
+        // Placed RSUs by RSU_MERGE_DISTANCE cell, for the merge check
+        std::map<std::pair<int64_t, int64_t>, std::vector<size_t>> m_rsuCells;
+};
+
+inline ScenarioGenerator::ScenarioGenerator(const ScenarioConfig& config)
+    : m_config(config),
+      m_rng(config.seed)
+{
+}
+
+inline double ScenarioGenerator::DrawSpeed() {
+    std::normal_distribution<double> speed(m_config.speedMean, m_config.speedStdDev);
+    return std::min(m_config.maxSpeed, std::max(m_config.minSpeed, speed(m_rng)));
+}
+
+inline void ScenarioGenerator::GeneratePlatoon(Scenario& scenario) {
+    for (uint32_t i = 0; i < m_config.numVehicles; ++i) {
+        scenario.vehicles.push_back({i * m_config.carSpacing, 0.0, 20.0, 0.0,
+                                     0.0, std::numeric_limits<double>::infinity()});
+    }
+    double rsuSpacing = (m_config.numVehicles * m_config.carSpacing) / (m_config.numRSUs + 1);
+    for (uint32_t i = 0; i < m_config.numRSUs; ++i) {
+        scenario.rsus.push_back({(i + 1) * rsuSpacing, 20.0});
+    }
+}
+
+inline void ScenarioGenerator::GenerateLanes(Scenario& scenario, const std::vector<RoadLane>& lanes) {
+    // Vehicles present at t=0 are spread over the lanes proportionally to
+    // their length
+    std::vector<double> cumulative;
+    double total = 0.0;
+    for (const auto& lane : lanes) {
+        total += lane.length;
+        cumulative.push_back(total);
+    }
+    std::uniform_real_distribution<double> along(0.0, total);
+    for (uint32_t i = 0; i < m_config.numVehicles; ++i) {
+        double offset = along(m_rng);
+        size_t l = std::lower_bound(cumulative.begin(), cumulative.end(), offset) - cumulative.begin();
+        const RoadLane& lane = lanes[std::min(l, lanes.size() - 1)];
+        double s = lane.length - (cumulative[std::min(l, lanes.size() - 1)] - offset);
+        double speed = DrawSpeed();
+        scenario.vehicles.push_back({lane.x0 + s * lane.dx, lane.y0 + s * lane.dy,
+                                     speed * lane.dx, speed * lane.dy,
+                                     0.0, (lane.length - s) / speed, lane.lane});
+    }
+
+    // Arrivals at the start of every lane
+    if (m_config.entryRate > 0) {
+        std::exponential_distribution<double> gap(m_config.entryRate);
+        for (const auto& lane : lanes) {
+            for (double t = gap(m_rng); t < m_config.simTime; t += gap(m_rng)) {
+                double speed = DrawSpeed();
+                scenario.vehicles.push_back({lane.x0 - speed * t * lane.dx, lane.y0 - speed * t * lane.dy,
+                                             speed * lane.dx, speed * lane.dy,
+                                             t, t + lane.length / speed, lane.lane});
+            }
+        }
+    }
+}
+
+inline void ScenarioGenerator::PlaceRsusAlong(Scenario& scenario, double x0, double y0,
+                                              double dx, double dy, double length) {
+    if (m_config.rsuDensity <= 0) {
+        return;
+    }
+    double spacing = 1000.0 / m_config.rsuDensity;
+    // RSUs sit beside the road, to the right of the direction of travel
+    double nx = dy;
+    double ny = -dx;
+    for (double s = spacing / 2; s < length; s += spacing) {
+        double x = x0 + s * dx + m_config.rsuOffset * nx;
+        double y = y0 + s * dy + m_config.rsuOffset * ny;
+        // Two streets can put an RSU on the same spot of an intersection,
+        // only that one is kept; nearby RSUs of parallel streets all stay
+        int64_t cx = std::floor(x / RSU_MERGE_DISTANCE);
+        int64_t cy = std::floor(y / RSU_MERGE_DISTANCE);
+        bool duplicate = false;
+        for (int64_t ix = cx - 1; ix <= cx + 1 && !duplicate; ++ix) {
+            for (int64_t iy = cy - 1; iy <= cy + 1 && !duplicate; ++iy) {
+                auto it = m_rsuCells.find({ix, iy});
+                if (it == m_rsuCells.end()) {
+                    continue;
+                }
+                for (size_t index : it->second) {
+                    const RsuSpec& rsu = scenario.rsus[index];
+                    if (std::hypot(rsu.x - x, rsu.y - y) < RSU_MERGE_DISTANCE) {
+                        duplicate = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (!duplicate) {
+            m_rsuCells[{cx, cy}].push_back(scenario.rsus.size());
+            scenario.rsus.push_back({x, y});
+        }
+    }
+}
+
+inline Scenario ScenarioGenerator::Generate() {
+    Scenario scenario;
+    m_rsuCells.clear();
+
+    if (m_config.type == "platoon") {
+        GeneratePlatoon(scenario);
+        return scenario;
+    }
+
+    std::vector<RoadLane> lanes;
+    double laneWidth = m_config.laneWidth;
+    // Lane k of a direction is offset (k + 0.5) lane widths from the centre
+    // line, to the right of travel
+    auto addStreet = [&](double x0, double y0, double dx, double dy, double length) {
+        for (uint32_t k = 0; k < m_config.lanesPerDirection; ++k) {
+            double offset = (k + 0.5) * laneWidth;
+            lanes.push_back({x0 + offset * dy, y0 - offset * dx, dx, dy, length, k});
+            lanes.push_back({x0 + length * dx - offset * dy, y0 + length * dy + offset * dx, -dx, -dy, length, k});
+        }
+        PlaceRsusAlong(scenario, x0, y0, dx, dy, length);
+    };
+
+    if (m_config.type == "highway") {
+        addStreet(0.0, 0.0, 1.0, 0.0, m_config.roadLength);
+    } else if (m_config.type == "grid") {
+        double width = m_config.gridCols * m_config.blockLength;
+        double height = m_config.gridRows * m_config.blockLength;
+        for (uint32_t r = 0; r <= m_config.gridRows; ++r) {
+            addStreet(0.0, r * m_config.blockLength, 1.0, 0.0, width);
+        }
+        for (uint32_t c = 0; c <= m_config.gridCols; ++c) {
+            addStreet(c * m_config.blockLength, 0.0, 0.0, 1.0, height);
+        }
+    } else {
+        return scenario;
+    }
+
+    GenerateLanes(scenario, lanes);
+    return scenario;
+}
+
+#endif // SCENARIO_GENERATOR_H
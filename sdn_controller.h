@@ -0,0 +1,351 @@
+#ifndef SDN_CONTROLLER_H
+#define SDN_CONTROLLER_H
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/ofswitch13-module.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+using namespace ns3;
+
+// Definition of SDN controller
+//
+// Besides reacting to packet-ins, the controller periodically polls port and
+// flow statistics from every switch it is connected to. Port counters feed a
+// per-port utilization model (EWMA of the egress rate over the port capacity)
+// and flow counters give the rate of every flow the controller installed.
+// Traffic entering on an RSU port is pinned to one of the uplink ports; when
+// an uplink runs above the target utilization, its heaviest flows are moved
+// to the coolest uplink by rewriting their flow entries.
+class SDNController: public OFSwitch13Controller  {
+    public:
+        void setPort(uint32_t port);
+        void SetStatsInterval(Time interval);
+        void SetTargetUtilization(double target);
+        void AddRsuPort(uint32_t port);
+        void AddUplinkPort(uint32_t port, DataRate capacity);
+        void AddClusterPrefix(Ipv4Address prefix, uint32_t length);
+        double GetPortUtilization(uint64_t dpId, uint32_t port) const;
+    protected:
+    void HandshakeSuccessful(Ptr<const RemoteSwitch> swtch) override;
+     ofl_err HandlePacketIn(struct ofl_msg_packet_in* msg,
+                            Ptr<const RemoteSwitch> swtch,
+                            uint32_t xid) override;
+     ofl_err HandleMultipartReply(struct ofl_msg_multipart_reply_header* msg,
+                                  Ptr<const RemoteSwitch> swtch,
+                                  uint32_t xid) override;
+    private:
+    struct PortState {
+        uint64_t txBytes = 0;
+        Time lastSample;
+        double utilization = 0.0;
+    };
+
+    struct FlowState {
+        std::string match;
+        uint16_t priority = 1000;
+        uint32_t outPort = 0;
+        uint64_t byteCount = 0;
+        Time lastSample;
+        double rate = 0.0; // bit/s
+    };
+
+    void PollStatistics();
+    void HandlePortStats(uint64_t dpId, struct ofl_msg_multipart_reply_port* reply);
+    void HandleFlowStats(uint64_t dpId, struct ofl_msg_multipart_reply_flow* reply);
+    void InstallFlow(uint64_t dpId, uint64_t cookie, const std::string& match, uint32_t outPort,
+                     uint16_t priority = 1000);
+    uint32_t SelectUplink(uint64_t dpId, double extraRate) const;
+    void Rebalance(uint64_t dpId);
+
+    // Cookies of the cluster prefix rules, the per-port rules use the port
+    static const uint64_t CLUSTER_COOKIE_BASE = 0x10000;
+
+    uint32_t m_port = 1;
+    Time m_statsInterval = Seconds(1);
+    double m_targetUtilization = 0.7;
+    double m_ewmaAlpha = 0.5;
+    std::vector<uint32_t> m_rsuPorts;
+    std::map<uint32_t, DataRate> m_uplinkCapacity;
+    std::vector<std::pair<Ipv4Address, uint32_t>> m_clusterPrefixes;
+    std::set<uint64_t> m_switches;
+    std::map<uint64_t, std::map<uint32_t, PortState>> m_portStats;
+    std::map<uint64_t, std::map<uint64_t, FlowState>> m_flows;
+    EventId m_pollEvent;
+};  
+
+
+void SDNController::setPort(uint32_t port) {
+        m_port = port;
+}
+
+void SDNController::SetStatsInterval(Time interval) {
+    m_statsInterval = interval;
+}
+
+void SDNController::SetTargetUtilization(double target) {
+    m_targetUtilization = target;
+}
+
+void SDNController::AddRsuPort(uint32_t port) {
+    m_rsuPorts.push_back(port);
+}
+
+void SDNController::AddUplinkPort(uint32_t port, DataRate capacity) {
+    m_uplinkCapacity[port] = capacity;
+}
+
+void SDNController::AddClusterPrefix(Ipv4Address prefix, uint32_t length) {
+    m_clusterPrefixes.emplace_back(prefix, length);
+}
+
+double SDNController::GetPortUtilization(uint64_t dpId, uint32_t port) const {
+    auto sw = m_portStats.find(dpId);
+    if (sw == m_portStats.end()) {
+        return 0.0;
+    }
+    auto it = sw->second.find(port);
+    return it == sw->second.end() ? 0.0 : it->second.utilization;
+}
+
+void SDNController::HandshakeSuccessful(Ptr<const RemoteSwitch> swtch) {
+
+    uint64_t dpId = swtch->GetDpId();
+    m_switches.insert(dpId);
+
+    // Both programs refuse to run without an uplink
+    NS_ABORT_MSG_IF(m_uplinkCapacity.empty(), "The controller needs at least one uplink port");
+
+    // Pin the traffic of every RSU port to an uplink
+    for (uint32_t rsuPort : m_rsuPorts) {
+        std::ostringstream match;
+        match << "in_port=" << rsuPort;
+        InstallFlow(dpId, rsuPort, match.str(), SelectUplink(dpId, 0.0));
+    }
+
+    // One wildcard rule per cluster prefix, above the per-port rules, so
+    // vehicle traffic is placed per cluster whatever RSU it comes from.
+    // Vehicles changing cluster are re-addressed and the rules stay put.
+    for (size_t i = 0; i < m_clusterPrefixes.size(); ++i) {
+        std::ostringstream match;
+        match << "eth_type=0x800,ip_src=" << m_clusterPrefixes[i].first << "/" << m_clusterPrefixes[i].second;
+        InstallFlow(dpId, CLUSTER_COOKIE_BASE + i, match.str(), SelectUplink(dpId, 0.0), 1100);
+    }
+
+    // Traffic coming back from the uplinks goes to every RSU port. It is
+    // never sent out of another uplink, so there is no forwarding loop.
+    std::ostringstream actions;
+    for (size_t i = 0; i < m_rsuPorts.size(); ++i) {
+        actions << (i ? "," : "") << "output=" << m_rsuPorts[i];
+    }
+    for (const auto& uplink : m_uplinkCapacity) {
+        std::ostringstream command;
+        command << "flow-mod cmd=add,table=0,prio=1000 in_port=" << uplink.first
+                << " apply:" << actions.str();
+        DpctlExecute(dpId, command.str());
+    }
+
+    if (!m_pollEvent.IsRunning()) {
+        m_pollEvent = Simulator::Schedule(m_statsInterval, &SDNController::PollStatistics, this);
+    }
+};
+
+ofl_err SDNController::HandlePacketIn(struct ofl_msg_packet_in* msg,
+                                      Ptr<const RemoteSwitch> swtch,
+                                      uint32_t xid) {
+
+    uint64_t dpId = swtch->GetDpId();
+    uint32_t inPort = m_port;
+    ofl_match_tlv* tlv = oxm_match_lookup(OXM_OF_IN_PORT, (ofl_match*)msg->match);
+    if (tlv) {
+        memcpy(&inPort, tlv->value, OXM_LENGTH(OXM_OF_IN_PORT));
+    }
+
+    // Extract the packet data from the message
+    uint8_t* packetData = msg->data;
+    uint32_t packetLength = msg->data_length;
+    uint32_t outPort = m_port;
+
+    if (!m_uplinkCapacity.count(inPort)) {
+        // Install a flow for this ingress port on the least loaded uplink
+        outPort = SelectUplink(dpId, 0.0);
+        std::ostringstream match;
+        match << "in_port=" << inPort;
+        InstallFlow(dpId, inPort, match.str(), outPort);
+    }
+
+    // Send the packet out the appropriate port
+    SendPacket(swtch, packetData, packetLength, outPort, inPort);
+
+    ofl_msg_free((ofl_msg_header*)msg, nullptr);
+    return 0;
+}
+
+ofl_err SDNController::HandleMultipartReply(struct ofl_msg_multipart_reply_header* msg,
+                                            Ptr<const RemoteSwitch> swtch,
+                                            uint32_t xid) {
+    uint64_t dpId = swtch->GetDpId();
+
+    switch (msg->type) {
+        case OFPMP_PORT_STATS:
+            HandlePortStats(dpId, (struct ofl_msg_multipart_reply_port*)msg);
+            break;
+        case OFPMP_FLOW:
+            HandleFlowStats(dpId, (struct ofl_msg_multipart_reply_flow*)msg);
+            Rebalance(dpId);
+            break;
+        default:
+            break;
+    }
+
+    ofl_msg_free((ofl_msg_header*)msg, nullptr);
+    return 0;
+}
+
+void SDNController::PollStatistics() {
+    // Port stats are requested first so that the utilization model is up to
+    // date when the flow stats reply triggers the rebalancing.
+    for (uint64_t dpId : m_switches) {
+        DpctlExecute(dpId, "stats-port");
+        DpctlExecute(dpId, "stats-flow");
+    }
+    m_pollEvent = Simulator::Schedule(m_statsInterval, &SDNController::PollStatistics, this);
+}
+
+void SDNController::HandlePortStats(uint64_t dpId, struct ofl_msg_multipart_reply_port* reply) {
+    Time now = Simulator::Now();
+    for (size_t i = 0; i < reply->stats_num; ++i) {
+        ofl_port_stats* stats = reply->stats[i];
+        auto capacity = m_uplinkCapacity.find(stats->port_no);
+        if (capacity == m_uplinkCapacity.end()) {
+            continue;
+        }
+
+        PortState& state = m_portStats[dpId][stats->port_no];
+        double elapsed = (now - state.lastSample).GetSeconds();
+        if (elapsed > 0 && stats->tx_bytes >= state.txBytes) {
+            double sample = (stats->tx_bytes - state.txBytes) * 8.0 / elapsed
+                            / capacity->second.GetBitRate();
+            state.utilization = m_ewmaAlpha * sample + (1 - m_ewmaAlpha) * state.utilization;
+        }
+        state.txBytes = stats->tx_bytes;
+        state.lastSample = now;
+    }
+}
+
+void SDNController::HandleFlowStats(uint64_t dpId, struct ofl_msg_multipart_reply_flow* reply) {
+    Time now = Simulator::Now();
+    auto& flows = m_flows[dpId];
+    for (size_t i = 0; i < reply->stats_num; ++i) {
+        ofl_flow_stats* stats = reply->stats[i];
+        auto it = flows.find(stats->cookie);
+        if (it == flows.end()) {
+            continue;
+        }
+
+        FlowState& flow = it->second;
+        double elapsed = (now - flow.lastSample).GetSeconds();
+        if (elapsed > 0 && stats->byte_count >= flow.byteCount) {
+            double sample = (stats->byte_count - flow.byteCount) * 8.0 / elapsed;
+            flow.rate = m_ewmaAlpha * sample + (1 - m_ewmaAlpha) * flow.rate;
+        }
+        flow.byteCount = stats->byte_count;
+        flow.lastSample = now;
+    }
+}
+
+void SDNController::InstallFlow(uint64_t dpId, uint64_t cookie, const std::string& match, uint32_t outPort,
+                                uint16_t priority) {
+    // A flow-mod add with an identical match and priority replaces the
+    // existing entry, which is how flows are moved between uplinks.
+    std::ostringstream command;
+    command << "flow-mod cmd=add,table=0,prio=" << priority << ",cookie=0x" << std::hex << cookie << std::dec
+            << " " << match << " apply:output=" << outPort;
+    DpctlExecute(dpId, command.str());
+
+    FlowState& flow = m_flows[dpId][cookie];
+    if (flow.match.empty()) {
+        flow.lastSample = Simulator::Now();
+    }
+    flow.match = match;
+    flow.priority = priority;
+    flow.outPort = outPort;
+}
+
+uint32_t SDNController::SelectUplink(uint64_t dpId, double extraRate) const {
+    // Pick the uplink with the lowest projected utilization. Before any stats
+    // arrive, the number of flows already pinned to a port breaks the tie.
+    uint32_t best = m_port;
+    double bestScore = std::numeric_limits<double>::max();
+    auto flows = m_flows.find(dpId);
+    for (const auto& uplink : m_uplinkCapacity) {
+        double load = GetPortUtilization(dpId, uplink.first)
+                      + extraRate / uplink.second.GetBitRate();
+        size_t pinned = 0;
+        if (flows != m_flows.end()) {
+            for (const auto& flow : flows->second) {
+                pinned += flow.second.outPort == uplink.first;
+            }
+        }
+        double score = load + 1e-6 * pinned;
+        if (score < bestScore) {
+            bestScore = score;
+            best = uplink.first;
+        }
+    }
+    return best;
+}
+
+void SDNController::Rebalance(uint64_t dpId) {
+    auto& flows = m_flows[dpId];
+    auto& ports = m_portStats[dpId];
+
+    for (const auto& uplink : m_uplinkCapacity) {
+        uint32_t hotPort = uplink.first;
+        double capacity = uplink.second.GetBitRate();
+        if (ports[hotPort].utilization <= m_targetUtilization) {
+            continue;
+        }
+
+        // Heaviest flows on the hot port first
+        std::vector<std::pair<double, uint64_t>> candidates;
+        for (const auto& flow : flows) {
+            if (flow.second.outPort == hotPort) {
+                candidates.emplace_back(flow.second.rate, flow.first);
+            }
+        }
+        std::sort(candidates.rbegin(), candidates.rend());
+
+        for (const auto& candidate : candidates) {
+            if (ports[hotPort].utilization <= m_targetUtilization) {
+                break;
+            }
+            double rate = candidate.first;
+            uint32_t coolPort = SelectUplink(dpId, rate);
+            if (coolPort == hotPort) {
+                break;
+            }
+            double coolCapacity = m_uplinkCapacity[coolPort].GetBitRate();
+            double coolAfter = ports[coolPort].utilization + rate / coolCapacity;
+            double hotAfter = ports[hotPort].utilization - rate / capacity;
+            // Only move when it lowers the peak of the two links
+            if (coolAfter >= ports[hotPort].utilization) {
+                continue;
+            }
+
+            FlowState& flow = flows[candidate.second];
+            NS_LOG_UNCOND("Moving flow " << flow.match << " from port " << hotPort
+                          << " to port " << coolPort << " (" << rate / 1e6 << " Mbps)");
+            InstallFlow(dpId, candidate.second, flow.match, coolPort, flow.priority);
+            ports[hotPort].utilization = hotAfter;
+            ports[coolPort].utilization = coolAfter;
+        }
+    }
+}
+
+#endif // SDN_CONTROLLER_H
@@ -1,72 +1,18 @@
 #include "cam.h"
+#include "event_profiler.h"
+#include "scenario_generator.h"
+#include "grid_spectrum_channel.h"
+#include "sdn_controller.h"
 #include <filesystem>
 #include "ns3/ofswitch13-module.h"
 #include "ns3/csma-module.h"
 #include "ns3/ipv4-global-routing-helper.h"
 #include "ns3/internet-module.h"
 #include "ns3/point-to-point-helper.h"
-
-// Definition of SDN controller
-class SDNController: public OFSwitch13Controller  {
-    public:
-        void setPort(uint32_t port);
-    protected:
-    void HandshakeSuccessful(Ptr<const RemoteSwitch> swtch) override;
-     ofl_err HandlePacketIn(struct ofl_msg_packet_in* msg,
-                            Ptr<const RemoteSwitch> swtch,
-                            uint32_t xid) override;
-    private:
-    uint32_t m_port = 1;
-};  
-
-
-void SDNController::setPort(uint32_t port) {
-        m_port = port;
-}
-
-void SDNController::HandshakeSuccessful(Ptr<const RemoteSwitch> swtch) {
-
-    uint64_t dpId = swtch->GetDpId();
-
-    // Create the flow rule command
-    std::string command = "flow-mod cmd=add,table=0,prio=1000 in_port=1 write:output=1";
-
-    // Execute the flow rule command
-    DpctlExecute(dpId, command2);
-
-};
-
-ofl_err SDNController::HandlePacketIn(struct ofl_msg_packet_in* msg,
-                                      Ptr<const RemoteSwitch> swtch,
-                                      uint32_t xid) {
-
-    uint64_t dpId = swtch->GetDpId();
-    uint32_t inPort = msg->in_port;
-
-    // Extract the packet data from the message
-    uint8_t* packetData = msg->data;
-    uint32_t packetLength = msg->data_length;
-    uint32_t etherType = GetPacketType(packetData, packetLength);
-
-    if (etherType == ETHERTYPE_IPv4) {
-        // Install a flow rule to prioritize the second switch
-        if (dpId == 2) {
-            std::ostringstream command;
-            command << "flow-mod cmd=add,table=0,prio=1000 "
-                    << "in_port=" << inPort << " "
-                    << "actions=output:" << m_port;
-            DpctlExecute(dpId, command.str());
-        }
-    }
-
-    // Send the packet out the appropriate port
-    SendPacket(swtch, msg->data, msg->data_length, m_port, inPort);
-
-    return ofl_err::OFPET_BAD_REQUEST;
-}
-
-
-
+#include "ns3/bridge-module.h"
+#include "ns3/applications-module.h"
+#include <map>
+#include <set>
 
 
 void SetUpLogging(bool verbose){
@@ -129,11 +75,123 @@ int main(int argc, char* argv[]){
 
     double simTime = 60.0; // Simulation time in seconds
 
+    // Road scenario, the default platoon is the original single-lane setup
+    ScenarioConfig scenarioConfig;
+    bool animation = true;
+
+    // Wireless channel, grid only delivers frames to receivers in range
+    std::string channel = "yans";
+    double channelRange = 0.0;
+
+    // RSU backhaul and controller load balancing
+    uint32_t numUplinks = 2;
+    std::string uplinkRate = "100Mbps";
+    double statsInterval = 1.0;
+    double targetUtilization = 0.7;
+
+    // CAM record and replay
+    std::string camTrace = "";
+    std::string replay = "";
+
+    // Addressing of the wireless network and optional vehicle uplink traffic
+    std::string addressing = "flat";
+    std::string uplinkTraffic = "";
+
+    // CAM transport, packet sends them straight over the 802.11p device and
+    // leaves the vehicles without an IP stack
+    std::string camTransport = "udp";
+
+    // Clustering engine used by the RSUs
+    std::string clusteringEngine = "kmeans";
+    uint32_t numClusters = 4;
+    double epochInterval = 0.0;
+    double clusteringDeadline = 0.0;
+    bool wallClockDeadline = false;
+    double predictionTolerance = 0.0;
+    uint32_t maxPredictedEpochs = 10;
+    bool downlink = false;
+    std::string clusterFeed = "";
+
+    // Event scheduler and profiling
+    std::string scheduler = "map";
+    bool profile = false;
+    std::string profileDepth = "";
+
     // Parse command line arguments
     CommandLine cmd;
     cmd.AddValue("numVehicles", "Number of vehicles", numVehicles);
     cmd.AddValue("simTime", "Simulation time", simTime);
+    cmd.AddValue("numRSUs", "Number of RSUs in the platoon scenario", numRSUs);
+    cmd.AddValue("scenario", "Road scenario: platoon, highway or grid", scenarioConfig.type);
+    cmd.AddValue("seed", "Seed of the scenario generator", scenarioConfig.seed);
+    cmd.AddValue("lanes", "Lanes per direction (highway, grid)", scenarioConfig.lanesPerDirection);
+    cmd.AddValue("roadLength", "Highway length in metres", scenarioConfig.roadLength);
+    cmd.AddValue("gridRows", "Blocks per column of the Manhattan grid", scenarioConfig.gridRows);
+    cmd.AddValue("gridCols", "Blocks per row of the Manhattan grid", scenarioConfig.gridCols);
+    cmd.AddValue("blockLength", "Block length of the Manhattan grid in metres", scenarioConfig.blockLength);
+    cmd.AddValue("speedMean", "Mean vehicle speed in m/s (highway, grid)", scenarioConfig.speedMean);
+    cmd.AddValue("speedStdDev", "Vehicle speed standard deviation in m/s (highway, grid)", scenarioConfig.speedStdDev);
+    cmd.AddValue("entryRate", "Vehicles per second entering every lane during the run", scenarioConfig.entryRate);
+    cmd.AddValue("rsuDensity", "RSUs per km of road (highway, grid)", scenarioConfig.rsuDensity);
+    cmd.AddValue("channel", "Wireless channel: yans (every node receives every frame) or grid (range-limited)", channel);
+    cmd.AddValue("channelRange", "Delivery range of the grid channel in metres (0 derives it from the link budget)", channelRange);
+    cmd.AddValue("animation", "Write the NetAnim animation file", animation);
+    cmd.AddValue("numUplinks", "Number of uplinks from the OpenFlow switch to the aggregation node", numUplinks);
+    cmd.AddValue("uplinkRate", "Data rate of the RSU and uplink CSMA links", uplinkRate);
+    cmd.AddValue("statsInterval", "Controller port/flow statistics polling interval in seconds", statsInterval);
+    cmd.AddValue("targetUtilization", "Uplink utilization above which the controller moves flows", targetUtilization);
+    cmd.AddValue("addressing", "Vehicle addressing: flat, or cluster (address prefix per cluster, one controller rule per cluster)", addressing);
+    cmd.AddValue("uplinkTraffic", "Data rate every vehicle sends to the aggregation node through its nearest RSU (e.g. 20kbps)", uplinkTraffic);
+    cmd.AddValue("camTransport", "CAM transport: udp, or packet (802.11p frames, no IP stack on the vehicles)", camTransport);
+    cmd.AddValue("camTrace", "Record every CAM received by the RSUs to this file", camTrace);
+    cmd.AddValue("replay", "Cluster the CAMs recorded in this file without simulating the network", replay);
+    cmd.AddValue("clusteringEngine", "Clustering engine: kmeans, grid (linear-time density clustering) or auto", clusteringEngine);
+    cmd.AddValue("numClusters", "Number of clusters for the k-means engine", numClusters);
+    cmd.AddValue("epochInterval", "Seconds between per-RSU clustering epochs (0 clusters once at the end)", epochInterval);
+    cmd.AddValue("clusteringDeadline", "Clustering deadline in milliseconds (0 is unbounded)", clusteringDeadline);
+    cmd.AddValue("wallClockDeadline", "Apply the deadline to real time instead of simulated compute time", wallClockDeadline);
+    cmd.AddValue("predictionTolerance", "Skip re-clustering while CAMs stay within this many metres of their predicted positions (0 disables)", predictionTolerance);
+    cmd.AddValue("maxPredictedEpochs", "Epochs in a row that may be predicted before clustering again", maxPredictedEpochs);
+    cmd.AddValue("downlink", "Broadcast every epoch's cluster assignments from the RSUs to their vehicles", downlink);
+    cmd.AddValue("scheduler", "Event scheduler: map, heap, calendar or priority", scheduler);
+    cmd.AddValue("profile", "Report wall time and event counts per event source and node role", profile);
+    cmd.AddValue("profileDepth", "Write the sampled event queue depth to this CSV file", profileDepth);
+    cmd.AddValue("clusterFeed", "Publish every clustering epoch to this POSIX shared memory feed (e.g. /vanet-clusters)", clusterFeed);
     cmd.Parse(argc, argv);
+    NS_ABORT_MSG_IF(numUplinks == 0, "At least one switch uplink is required");
+    NS_ABORT_MSG_IF(addressing != "flat" && addressing != "cluster", "Unknown addressing " << addressing);
+    NS_ABORT_MSG_IF(camTransport != "udp" && camTransport != "packet", "Unknown CAM transport " << camTransport);
+    const bool packetCAMs = camTransport == "packet";
+    NS_ABORT_MSG_IF(packetCAMs && (addressing == "cluster" || !uplinkTraffic.empty()),
+                    "Cluster addressing and uplink traffic need an IP stack on the vehicles, use --camTransport=udp");
+    SetUpScheduler(scheduler, profile || !profileDepth.empty());
+
+    scenarioConfig.numVehicles = numVehicles;
+    scenarioConfig.numRSUs = numRSUs;
+    scenarioConfig.carSpacing = carSpacing;
+    scenarioConfig.simTime = simTime;
+    Scenario scenario = ScenarioGenerator(scenarioConfig).Generate();
+    numVehicles = scenario.vehicles.size();
+    numRSUs = scenario.rsus.size();
+    NS_ABORT_MSG_IF(numRSUs == 0, "The " << scenarioConfig.type << " scenario has no RSUs");
+    NS_LOG_UNCOND("Scenario " << scenarioConfig.type << ": " << numVehicles << " vehicles, " << numRSUs << " RSUs");
+
+    std::shared_ptr<ClusteringEngine> engine = CreateClusteringEngine(clusteringEngine, numClusters);
+    NS_ABORT_MSG_IF(!engine, "Unknown clustering engine " << clusteringEngine);
+
+    if (!clusterFeed.empty() && !globalClusterFeed.Create(clusterFeed)) {
+        NS_FATAL_ERROR("Cannot create cluster feed " << clusterFeed);
+    }
+
+    if (!replay.empty()) {
+        ReplayCAMTrace(replay, engine);
+        globalClusterFeed.Close();
+        return 0;
+    }
+
+    if (!camTrace.empty() && !globalCAMTrace.Open(camTrace)) {
+        NS_FATAL_ERROR("Cannot open CAM trace " << camTrace);
+    }
 
     // Set up an 802.11p WiFI Network which is standard for vehicular networks
     WifiHelper wifiHelper = WifiHelper();
@@ -142,14 +200,37 @@ int main(int argc, char* argv[]){
     // Set up MAC and PHY layers
     NqosWaveMacHelper wifiMac = NqosWaveMacHelper::Default();
     YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default();
-    YansWifiPhyHelper wifiPhy = YansWifiPhyHelper();
-    wifiPhy.SetChannel(wifiChannel.Create());
-    wifiPhy.Set("TxPowerStart", DoubleValue(30.0));
-    wifiPhy.Set("TxPowerEnd", DoubleValue(30.0));
+    YansWifiPhyHelper yansPhy = YansWifiPhyHelper();
+    SpectrumWifiPhyHelper spectrumPhy = SpectrumWifiPhyHelper();
+    Ptr<GridSpectrumChannel> gridChannel;
+    WifiPhyHelper* wifiPhy = &yansPhy;
+    const double txPowerDbm = 30.0;
+    if (channel == "yans") {
+        yansPhy.SetChannel(wifiChannel.Create());
+    } else if (channel == "grid") {
+        // Same loss and delay models as the YANS default
+        gridChannel = CreateObject<GridSpectrumChannel>();
+        gridChannel->AddPropagationLossModel(CreateObject<LogDistancePropagationLossModel>());
+        gridChannel->SetPropagationDelayModel(CreateObject<ConstantSpeedPropagationDelayModel>());
+        gridChannel->SetAttribute("MaxSpeed", DoubleValue(scenarioConfig.maxSpeed));
+        if (channelRange > 0) {
+            gridChannel->SetAttribute("MaxRange", DoubleValue(channelRange));
+        } else {
+            // -101 dBm is the default WifiPhy RxSensitivity
+            gridChannel->SetMaxRangeFromLinkBudget(txPowerDbm, -101.0);
+        }
+        spectrumPhy.SetChannel(gridChannel);
+        wifiPhy = &spectrumPhy;
+        NS_LOG_UNCOND("Grid channel range " << gridChannel->GetMaxRange() << " m");
+    } else {
+        NS_FATAL_ERROR("Unknown channel " << channel);
+    }
+    wifiPhy->Set("TxPowerStart", DoubleValue(txPowerDbm));
+    wifiPhy->Set("TxPowerEnd", DoubleValue(txPowerDbm));
 
     // set up csma
     CsmaHelper csmaHelper;
-    csmaHelper.SetChannelAttribute("DataRate", DataRateValue(DataRate("100Mbps")));
+    csmaHelper.SetChannelAttribute("DataRate", DataRateValue(DataRate(uplinkRate)));
     csmaHelper.SetChannelAttribute("Delay", TimeValue(MilliSeconds(2)));
 
 
@@ -175,25 +256,70 @@ int main(int argc, char* argv[]){
     ofControllerNodes.Create(1);
     Ptr<Node> ofController = ofControllerNodes.Get(0);
 
+    // Aggregation node behind the switch uplinks, it collects the RSU traffic
+    NodeContainer aggregatorNodes;
+    aggregatorNodes.Create(1);
+    Ptr<Node> aggregator = aggregatorNodes.Get(0);
+
+    // Node roles for the event profiler
+    for (uint32_t i = 0; i < numVehicles; ++i) {
+        ProfilingScheduler::SetNodeRole(vehicles.Get(i)->GetId(), "vehicle");
+    }
+    for (uint32_t i = 0; i < numRSUs; ++i) {
+        ProfilingScheduler::SetNodeRole(rsus.Get(i)->GetId(), "rsu");
+    }
+    ProfilingScheduler::SetNodeRole(ofSwitch->GetId(), "switch");
+    ProfilingScheduler::SetNodeRole(ofController->GetId(), "controller");
+    ProfilingScheduler::SetNodeRole(aggregator->GetId(), "aggregator");
+
     // Define a node container for all nodes
     NodeContainer allNodes = NodeContainer(vehicles, rsus,  ofSwitch, ofController);
 
     //Install the wifi devices
-    NetDeviceContainer wifiDevices = wifiHelper.Install(wifiPhy, wifiMac, allNodes);
+    NetDeviceContainer wifiDevices = wifiHelper.Install(*wifiPhy, wifiMac, allNodes);
 
-    //Set up csma devices
-    NodeContainer csmaNodes = NodeContainer(rsus.Get(numRSUs - 1), ofSwitch);
-    NetDeviceContainer csmaDevices = csmaHelper.Install(csmaNodes);
+    //Set up csma devices, every RSU gets its own switch port (ports 1..numRSUs)
+    NetDeviceContainer switchPorts;
+    NetDeviceContainer backhaulDevices;
+    for (uint32_t i = 0; i < numRSUs; ++i) {
+        NetDeviceContainer link = csmaHelper.Install(NodeContainer(rsus.Get(i), ofSwitch));
+        backhaulDevices.Add(link.Get(0));
+        switchPorts.Add(link.Get(1));
+    }
+
+    // The uplinks follow the RSU ports. On the aggregation node they are
+    // bridged, so whichever uplink the controller picks reaches the same host.
+    NetDeviceContainer aggregatorPorts;
+    for (uint32_t i = 0; i < numUplinks; ++i) {
+        NetDeviceContainer link = csmaHelper.Install(NodeContainer(ofSwitch, aggregator));
+        switchPorts.Add(link.Get(0));
+        aggregatorPorts.Add(link.Get(1));
+    }
+    BridgeHelper bridge;
+    NetDeviceContainer aggregatorDevices = bridge.Install(aggregator, aggregatorPorts);
     
 
     //Install openflow switch and connect it to the controller
     Ptr<OFSwitch13InternalHelper> of13Helper = CreateObject<OFSwitch13InternalHelper>();
     Ptr<SDNController> ctrl = CreateObject<SDNController>();
-    // set the port
+    ctrl->SetStatsInterval(Seconds(statsInterval));
+    ctrl->SetTargetUtilization(targetUtilization);
+    for (uint32_t i = 0; i < numRSUs; ++i) {
+        ctrl->AddRsuPort(i + 1);
+    }
+    for (uint32_t i = 0; i < numUplinks; ++i) {
+        ctrl->AddUplinkPort(numRSUs + i + 1, DataRate(uplinkRate));
+    }
+    ctrl->setPort(numRSUs + 1);
+    if (addressing == "cluster") {
+        // Every RSU can hand out numClusters cluster prefixes
+        globalClusterAddressing.Configure(numVehicles + numRSUs, numRSUs * numClusters);
+        for (uint32_t i = 1; i < globalClusterAddressing.GetNumPrefixes(); ++i) {
+            ctrl->AddClusterPrefix(globalClusterAddressing.GetPrefix(i), globalClusterAddressing.GetPrefixLength());
+        }
+    }
 
-    of13Helper->InstallController(ofController);//, ctrl);
-    NetDeviceContainer switchPorts;
-    switchPorts.Add(csmaDevices.Get(1));
+    of13Helper->InstallController(ofController, ctrl);
     of13Helper->InstallSwitch(ofSwitch,  switchPorts);
     of13Helper->CreateOpenFlowChannels();
 
@@ -201,16 +327,47 @@ int main(int argc, char* argv[]){
     NS_LOG_UNCOND("Installing Internet Stack");
     // Install the Internet Stack and assign IP addresses
     InternetStackHelper internet = InternetStackHelper();
-    internet.Install(vehicles);
+    PacketSocketHelper packetSocket;
+    if (packetCAMs) {
+        packetSocket.Install(vehicles);
+        packetSocket.Install(rsus);
+    } else {
+        internet.Install(vehicles);
+    }
     internet.Install(rsus);
+    internet.Install(aggregator);
     // internet.Install(ofSwitch);
     // internet.Install(ofController);
     
     NS_LOG_UNCOND("Installed Internet Stack");
 
+    // Only the vehicles and RSUs have an IP stack on the wireless network,
+    // their devices come first in wifiDevices. With packet CAMs only the RSUs.
     Ipv4AddressHelper ipv4;
-    ipv4.SetBase("10.0.0.0", "255.255.0.0");
-    Ipv4InterfaceContainer interfaces = ipv4.Assign(wifiDevices);
+    if (globalClusterAddressing.IsEnabled()) {
+        for (uint32_t i = 0; i < numVehicles + numRSUs; ++i) {
+            globalClusterAddressing.AddDevice(wifiDevices.Get(i), i + 1, i < numVehicles);
+        }
+    } else {
+        // A /14 leaves room for the 100k-vehicle scenarios
+        ipv4.SetBase("10.0.0.0", "255.252.0.0");
+        NetDeviceContainer ipDevices;
+        for (uint32_t i = packetCAMs ? numVehicles : 0; i < numVehicles + numRSUs; ++i) {
+            ipDevices.Add(wifiDevices.Get(i));
+        }
+        ipv4.Assign(ipDevices);
+    }
+
+    // RSU backhaul subnet, the aggregation node takes the last address
+    ipv4.SetBase("10.254.0.0", "255.255.255.0");
+    ipv4.Assign(backhaulDevices);
+    ipv4.SetBase("10.254.0.0", "255.255.255.0", "0.0.0.254");
+    Ipv4InterfaceContainer aggregatorInterfaces = ipv4.Assign(aggregatorDevices);
+
+    // Sink for the cluster updates sent by the RSUs
+    PacketSinkHelper clusterSink("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), 10));
+    ApplicationContainer sinkApps = clusterSink.Install(aggregator);
+    sinkApps.Start(Seconds(0.0));
     
     
 
@@ -228,19 +385,18 @@ int main(int argc, char* argv[]){
     mobility.SetMobilityModel("ns3::ConstantVelocityMobilityModel");
 
     Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator>();
-    for (uint32_t i = 0; i < numVehicles; ++i) {
-        positionAlloc->Add(Vector(i * carSpacing, 0.0, 0.0));
+    for (const auto& vehicle : scenario.vehicles) {
+        positionAlloc->Add(Vector(vehicle.x, vehicle.y, 0.0));
     }
     mobility.SetPositionAllocator(positionAlloc);
 
 
     mobility.Install(vehicles);
     
-    for (NodeContainer::Iterator iter = vehicles.Begin(); iter != vehicles.End(); ++iter) {
-        Ptr<Node> node = *iter;
-        Ptr<ConstantVelocityMobilityModel> mobModel = node->GetObject<ConstantVelocityMobilityModel>();
+    for (uint32_t i = 0; i < numVehicles; ++i) {
+        Ptr<ConstantVelocityMobilityModel> mobModel = vehicles.Get(i)->GetObject<ConstantVelocityMobilityModel>();
         if (mobModel) {
-            mobModel->SetVelocity(Vector(20.0, 0.0, 0.0)); // e.g., 20 meters per second along the x-axis
+            mobModel->SetVelocity(Vector(scenario.vehicles[i].vx, scenario.vehicles[i].vy, 0.0));
         }
     }
 
@@ -251,10 +407,8 @@ int main(int argc, char* argv[]){
 
     
     //Place the RSUs
-    double rsuSpacing  = (numVehicles * carSpacing) / (numRSUs + 1);
-    
-    for (uint32_t i = 0; i < numRSUs; ++i){
-        rsuPsitionAlloc->Add(Vector((i + 1) * rsuSpacing, 20.0, 0.0));
+    for (const auto& rsu : scenario.rsus){
+        rsuPsitionAlloc->Add(Vector(rsu.x, rsu.y, 0.0));
     }
 
     rsuMobility.SetPositionAllocator(rsuPsitionAlloc);
@@ -285,6 +439,15 @@ int main(int argc, char* argv[]){
     ofMobility.SetPositionAllocator(ofControllerAlloc);
     ofMobility.Install(ofControllerNodes);
 
+    Ptr<ListPositionAllocator> aggregatorAlloc = CreateObject<ListPositionAllocator>();
+    aggregatorAlloc->Add(Vector(
+        rsus.Get(numRSUs - 1)->GetObject<MobilityModel>()->GetPosition().x + 30.0,
+        rsus.Get(numRSUs - 1)->GetObject<MobilityModel>()->GetPosition().y + 30.0,
+        0.0)
+        );
+    ofMobility.SetPositionAllocator(aggregatorAlloc);
+    ofMobility.Install(aggregatorNodes);
+
 
 
 
@@ -296,25 +459,58 @@ int main(int argc, char* argv[]){
 
     // add CAM Clients to the vehicles
     for (uint32_t i = 0; i < numVehicles; ++i) {
+        // Vehicles only beacon while they are on the road
+        const VehicleSpec& spec = scenario.vehicles[i];
+        double stopTime = std::min(spec.exitTime, simTime - 5);
+        if (spec.entryTime >= stopTime) {
+            continue;
+        }
         Ptr<CAMClient> camClient = CreateObject<CAMClient>();
 
         // Get the index of the nearest RSU
         uint32_t nearestRSUIndex = GetNearestRSU(vehicles.Get(i), rsus);
 
         // Set the remote address to the nearest RSU
-        camClient->SetRemote(rsus.Get(nearestRSUIndex)->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(), 9);
+        Ipv4Address rsuAddress = rsus.Get(nearestRSUIndex)->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal();
+        if (packetCAMs) {
+            camClient->SetRemote(wifiDevices.Get(i), wifiDevices.Get(numVehicles + nearestRSUIndex)->GetAddress());
+        } else {
+            camClient->SetRemote(rsuAddress, 9);
+        }
         camClient->SetInterval(Seconds(1));
+        camClient->SetLane(spec.lane);
+        camClient->SetDownlinkPort(downlink ? 11 : 0);
         vehicles.Get(i)->AddApplication(camClient);
-        camClient->SetStartTime(Seconds(0.0));
-        camClient->SetStopTime(Seconds(simTime - 5));
+        camClient->SetStartTime(Seconds(spec.entryTime));
+        camClient->SetStopTime(Seconds(stopTime));
+
+        // Uplink traffic is routed through the same RSU and its switch port
+        if (!uplinkTraffic.empty()) {
+            Ipv4StaticRoutingHelper staticRouting;
+            staticRouting.GetStaticRouting(vehicles.Get(i)->GetObject<Ipv4>())->SetDefaultRoute(rsuAddress, 1);
+            OnOffHelper uplink("ns3::UdpSocketFactory", InetSocketAddress(aggregatorInterfaces.GetAddress(0), 10));
+            uplink.SetConstantRate(DataRate(uplinkTraffic), 200);
+            ApplicationContainer uplinkApp = uplink.Install(vehicles.Get(i));
+            uplinkApp.Start(Seconds(spec.entryTime));
+            uplinkApp.Stop(Seconds(stopTime));
+        }
     }
 
     //add CAM Servers to the RSUs
     for(uint32_t i = 0; i < numRSUs; ++i){
         Ptr<CAMServer> camServer = CreateObject<CAMServer>();
-        camServer->SetLocal(rsus.Get(i)->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(), 9);
+        if (packetCAMs) {
+            camServer->SetLocal(wifiDevices.Get(numVehicles + i));
+        } else {
+            camServer->SetLocal(rsus.Get(i)->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(), 9);
+        }
         camServer->SetNumRSUs(numRSUs);
-        camServer->SetSwitch(ofSwitch->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(), 10);
+        camServer->SetClusteringEngine(engine);
+        camServer->SetEpochInterval(Seconds(epochInterval));
+        camServer->SetClusteringDeadline(Seconds(clusteringDeadline / 1000.0), wallClockDeadline);
+        camServer->SetPrediction(predictionTolerance, maxPredictedEpochs);
+        camServer->SetDownlink(downlink ? 11 : 0);
+        camServer->SetSwitch(aggregatorInterfaces.GetAddress(0), 10);
         rsus.Get(i)->AddApplication(camServer);
         camServer->SetStartTime(Seconds(0.0));
         camServer->SetStopTime(Seconds(simTime - 5));
@@ -322,47 +518,69 @@ int main(int argc, char* argv[]){
     NS_LOG_UNCOND("Added RSUs and Vehicles");
 
 
-    // Create the animation file
-    AnimationInterface anim("vehicular_network_animation.xml");
-    // anim.EnablePacketMetadata(); // Optional
-    // get current working directory
-    std::string cwd = std::filesystem::current_path().string();
-    uint32_t imageID =  anim.AddResource(cwd + "/scratch/car.png");
-    uint32_t rsuImageID =  anim.AddResource(cwd + "/scratch/rsu.png");
+    // Create the animation file, off for large scenarios
+    std::unique_ptr<AnimationInterface> animPtr;
+    if (animation) {
+        animPtr = std::make_unique<AnimationInterface>("vehicular_network_animation.xml");
+        AnimationInterface& anim = *animPtr;
+        // anim.EnablePacketMetadata(); // Optional
+        // get current working directory
+        std::string cwd = std::filesystem::current_path().string();
+        uint32_t imageID =  anim.AddResource(cwd + "/scratch/car.png");
+        uint32_t rsuImageID =  anim.AddResource(cwd + "/scratch/rsu.png");
     
-    // put no node description on all the vehicles, but for the RSUs, add a description RSU and the RSU number
-    for (uint32_t i = 0; i < numVehicles; ++i) {
-        anim.UpdateNodeDescription(vehicles.Get(i), "");
-        anim.UpdateNodeSize(vehicles.Get(i), 200, 200);
-    }
-    for (uint32_t i = 0; i < numRSUs; ++i) {
-        anim.UpdateNodeDescription(rsus.Get(i), "RSU " + std::to_string(i + 1));
-        //increase the size of the Nodes
-        anim.UpdateNodeSize(rsus.Get(i), 200, 200);
-    }
+        // put no node description on all the vehicles, but for the RSUs, add a description RSU and the RSU number
+        for (uint32_t i = 0; i < numVehicles; ++i) {
+            anim.UpdateNodeDescription(vehicles.Get(i), "");
+            anim.UpdateNodeSize(vehicles.Get(i), 200, 200);
+        }
+        for (uint32_t i = 0; i < numRSUs; ++i) {
+            anim.UpdateNodeDescription(rsus.Get(i), "RSU " + std::to_string(i + 1));
+            //increase the size of the Nodes
+            anim.UpdateNodeSize(rsus.Get(i), 200, 200);
+        }
     
-    // change the icon of the vehicles to a car
-    for (uint32_t i = 0; i < numVehicles; ++i) {
-        // the node id should be an integer
-        anim.UpdateNodeImage(vehicles.Get(i)->GetId(), imageID);
-    }   
-
-    for(uint32_t i = 0; i < numRSUs; ++i){
-        anim.UpdateNodeImage(rsus.Get(i)->GetId(), rsuImageID);
-    }
+        // change the icon of the vehicles to a car
+        for (uint32_t i = 0; i < numVehicles; ++i) {
+            // the node id should be an integer
+            anim.UpdateNodeImage(vehicles.Get(i)->GetId(), imageID);
+        }   
+
+        for(uint32_t i = 0; i < numRSUs; ++i){
+            anim.UpdateNodeImage(rsus.Get(i)->GetId(), rsuImageID);
+        }
     
     
-    anim.UpdateNodeSize(ofController, 200, 200);
-    anim.UpdateNodeDescription(ofController, "SDN Controller");
+        anim.UpdateNodeSize(ofController, 200, 200);
+        anim.UpdateNodeDescription(ofController, "SDN Controller");
 
-    anim.UpdateNodeSize(ofSwitch, 200, 200);
-    anim.UpdateNodeDescription(ofSwitch, "OpenFlow Switch");
+        anim.UpdateNodeSize(ofSwitch, 200, 200);
+        anim.UpdateNodeDescription(ofSwitch, "OpenFlow Switch");
+
+        anim.UpdateNodeSize(aggregator, 200, 200);
+        anim.UpdateNodeDescription(aggregator, "Aggregation Node");
+    }
 
 
     // start the simulation
     Simulator::Stop(Seconds(simTime));
     Simulator::Run();
+    if (ProfilingScheduler* profiler = ProfilingScheduler::GetInstance()) {
+        profiler->Report(std::cout);
+        if (!profileDepth.empty()) {
+            profiler->WriteDepthSamples(profileDepth);
+        }
+    }
+    if (globalClusterAddressing.IsEnabled()) {
+        NS_LOG_UNCOND("Cluster addressing: " << globalClusterAddressing.GetNumPrefixes() - 1
+                      << " cluster prefixes, " << globalClusterAddressing.GetReaddressed() << " vehicles re-addressed");
+    }
+    if (gridChannel) {
+        NS_LOG_UNCOND("Grid channel scheduled " << gridChannel->GetDeliveries() << " receptions");
+    }
     Simulator::Destroy();
+    globalCAMTrace.Close();
+    globalClusterFeed.Close();
 
 
     return 0;
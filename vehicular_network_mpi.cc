@@ -0,0 +1,423 @@
+#include "cam.h"
+#include "event_profiler.h"
+#include "scenario_generator.h"
+#include "grid_spectrum_channel.h"
+#include "sdn_controller.h"
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#endif
+#include "ns3/ofswitch13-module.h"
+#include "ns3/csma-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-helper.h"
+#include "ns3/bridge-module.h"
+#include "ns3/applications-module.h"
+#include <chrono>
+
+// Distributed version of vehicular_network for long highway corridors.
+//
+// The road is cut into one segment per MPI rank along x. A rank owns the
+// RSUs of its segment, the 802.11p channel of the segment and the vehicles
+// while they drive through it. Every RSU reaches the switch over a
+// point-to-point link to a segment gateway next to the switch; the switch,
+// controller, aggregation node and gateways live on rank 0, so these links
+// are the only traffic crossing ranks and their delay is the lookahead.
+//
+// ns-3 nodes cannot move between ranks. A vehicle is instead simulated by
+// one node per segment it drives through, each beaconing only while the
+// vehicle is inside its segment and all sending the same vehicle id, so the
+// vehicle is handed over to the next rank at the segment boundary. The
+// channels are per segment: frames do not cross a boundary.
+//
+// Without --enable-mpi the program only reports that it needs it, so that
+// building the scratch directory still works.
+
+#ifdef NS3_MPI
+
+// Aggregation node address on the backhaul subnet, as in vehicular_network
+const Ipv4Address AGGREGATOR_ADDRESS("10.254.0.254");
+
+// Time window [first, second) the vehicle spends in [segStart, segEnd) on
+// the x axis, clipped to [from, to). The window is empty when first >= second.
+std::pair<double, double> SegmentWindow(const VehicleSpec& spec, double segStart, double segEnd,
+                                        double from, double to) {
+    if (spec.vx == 0) {
+        bool inside = spec.x >= segStart && spec.x < segEnd;
+        return inside ? std::make_pair(from, to) : std::make_pair(0.0, 0.0);
+    }
+    double enter = (segStart - spec.x) / spec.vx;
+    double leave = (segEnd - spec.x) / spec.vx;
+    return {std::max(from, std::min(enter, leave)), std::min(to, std::max(enter, leave))};
+}
+
+int main(int argc, char* argv[]){
+
+    // Enable checksum computations (required by OFSwitch13 module)
+    GlobalValue::Bind("ChecksumEnabled", BooleanValue(true));
+
+    double simTime = 60.0;
+
+    // A 50 km highway by default
+    ScenarioConfig scenarioConfig;
+    scenarioConfig.type = "highway";
+    scenarioConfig.numVehicles = 2000;
+    scenarioConfig.roadLength = 50000.0;
+
+    std::string channel = "yans";
+    double channelRange = 0.0;
+
+    // RSU backhaul, the lookahead of the distributed simulation
+    std::string backhaulRate = "100Mbps";
+    double backhaulDelay = 2.0;
+    uint32_t numUplinks = 2;
+    double statsInterval = 1.0;
+    double targetUtilization = 0.7;
+
+    std::string clusteringEngine = "kmeans";
+    uint32_t numClusters = 4;
+    double epochInterval = 0.0;
+    double predictionTolerance = 0.0;
+    uint32_t maxPredictedEpochs = 10;
+    bool downlink = false;
+    std::string camTransport = "udp";
+
+    std::string scheduler = "map";
+    bool nullMessages = false;
+
+    CommandLine cmd;
+    cmd.AddValue("numVehicles", "Number of vehicles on the road at t=0", scenarioConfig.numVehicles);
+    cmd.AddValue("simTime", "Simulation time", simTime);
+    cmd.AddValue("seed", "Seed of the scenario generator", scenarioConfig.seed);
+    cmd.AddValue("lanes", "Lanes per direction", scenarioConfig.lanesPerDirection);
+    cmd.AddValue("roadLength", "Highway length in metres, split evenly between the ranks", scenarioConfig.roadLength);
+    cmd.AddValue("speedMean", "Mean vehicle speed in m/s", scenarioConfig.speedMean);
+    cmd.AddValue("speedStdDev", "Vehicle speed standard deviation in m/s", scenarioConfig.speedStdDev);
+    cmd.AddValue("entryRate", "Vehicles per second entering every lane during the run", scenarioConfig.entryRate);
+    cmd.AddValue("rsuDensity", "RSUs per km of road", scenarioConfig.rsuDensity);
+    cmd.AddValue("channel", "Wireless channel of every segment: yans or grid (range-limited)", channel);
+    cmd.AddValue("channelRange", "Delivery range of the grid channel in metres (0 derives it from the link budget)", channelRange);
+    cmd.AddValue("backhaulRate", "Data rate of the RSU point-to-point links and the switch links", backhaulRate);
+    cmd.AddValue("backhaulDelay", "Delay of the RSU point-to-point links in milliseconds (the lookahead between ranks)", backhaulDelay);
+    cmd.AddValue("numUplinks", "Number of uplinks from the OpenFlow switch to the aggregation node", numUplinks);
+    cmd.AddValue("statsInterval", "Controller port/flow statistics polling interval in seconds", statsInterval);
+    cmd.AddValue("targetUtilization", "Uplink utilization above which the controller moves flows", targetUtilization);
+    cmd.AddValue("clusteringEngine", "Clustering engine: kmeans, grid (linear-time density clustering) or auto", clusteringEngine);
+    cmd.AddValue("numClusters", "Number of clusters for the k-means engine", numClusters);
+    cmd.AddValue("epochInterval", "Seconds between per-RSU clustering epochs (0 clusters once at the end)", epochInterval);
+    cmd.AddValue("predictionTolerance", "Skip re-clustering while CAMs stay within this many metres of their predicted positions (0 disables)", predictionTolerance);
+    cmd.AddValue("maxPredictedEpochs", "Epochs in a row that may be predicted before clustering again", maxPredictedEpochs);
+    cmd.AddValue("downlink", "Broadcast every epoch's cluster assignments from the RSUs to their vehicles", downlink);
+    cmd.AddValue("camTransport", "CAM transport: udp, or packet (802.11p frames, no IP stack on the vehicles)", camTransport);
+    cmd.AddValue("scheduler", "Event scheduler: map, heap, calendar or priority", scheduler);
+    cmd.AddValue("nullMessages", "Synchronize the ranks with null messages instead of the global barrier", nullMessages);
+    cmd.Parse(argc, argv);
+    NS_ABORT_MSG_IF(numUplinks == 0, "At least one switch uplink is required");
+    NS_ABORT_MSG_IF(backhaulDelay <= 0, "The backhaul delay is the lookahead and must be positive");
+    NS_ABORT_MSG_IF(camTransport != "udp" && camTransport != "packet", "Unknown CAM transport " << camTransport);
+    const bool packetCAMs = camTransport == "packet";
+
+    GlobalValue::Bind("SimulatorImplementationType",
+                      StringValue(nullMessages ? "ns3::NullMessageSimulatorImpl" : "ns3::DistributedSimulatorImpl"));
+    MpiInterface::Enable(&argc, &argv);
+    const uint32_t rank = MpiInterface::GetSystemId();
+    const uint32_t numRanks = MpiInterface::GetSize();
+    SetUpScheduler(scheduler, false);
+
+    // Every rank clusters its own RSUs at the end, into rank<N>_cluster<M>.csv
+    globalClusterCSVPrefix = "rank" + std::to_string(rank) + "_cluster";
+
+    // Every rank generates the same scenario from the seed
+    scenarioConfig.simTime = simTime;
+    Scenario scenario = ScenarioGenerator(scenarioConfig).Generate();
+    const uint32_t numRSUs = scenario.rsus.size();
+    const double segmentLength = scenarioConfig.roadLength / numRanks;
+    auto segmentOf = [&](double x) {
+        return std::min(numRanks - 1, uint32_t(std::max(0.0, x / segmentLength)));
+    };
+
+    std::vector<uint32_t> rsuRank(numRSUs);
+    std::vector<uint32_t> rsusPerRank(numRanks, 0);
+    for (uint32_t i = 0; i < numRSUs; ++i) {
+        rsuRank[i] = segmentOf(scenario.rsus[i].x);
+        ++rsusPerRank[rsuRank[i]];
+    }
+    for (uint32_t r = 0; r < numRanks; ++r) {
+        NS_ABORT_MSG_IF(rsusPerRank[r] == 0, "Segment " << r << " has no RSU, use fewer ranks or a higher rsuDensity");
+    }
+    if (rank == 0) {
+        NS_LOG_UNCOND("Scenario highway: " << scenario.vehicles.size() << " vehicles, " << numRSUs << " RSUs, "
+                      << numRanks << " segments of " << segmentLength << " m");
+    }
+
+    std::shared_ptr<ClusteringEngine> engine = CreateClusteringEngine(clusteringEngine, numClusters);
+    NS_ABORT_MSG_IF(!engine, "Unknown clustering engine " << clusteringEngine);
+
+    // The infrastructure is created in the same order on every rank, so its
+    // node ids match across ranks; the vehicles are created last and only
+    // on their own rank.
+    NodeContainer ofSwitchNodes;
+    ofSwitchNodes.Create(1, 0);
+    Ptr<Node> ofSwitch = ofSwitchNodes.Get(0);
+    NodeContainer ofControllerNodes;
+    ofControllerNodes.Create(1, 0);
+    Ptr<Node> ofController = ofControllerNodes.Get(0);
+    NodeContainer aggregatorNodes;
+    aggregatorNodes.Create(1, 0);
+    Ptr<Node> aggregator = aggregatorNodes.Get(0);
+    NodeContainer gateways;
+    gateways.Create(numRanks, 0);
+
+    NodeContainer rsus;
+    NodeContainer localRsus;
+    std::vector<uint32_t> localRsuIndex;
+    for (uint32_t i = 0; i < numRSUs; ++i) {
+        Ptr<Node> rsu = CreateObject<Node>(rsuRank[i]);
+        rsus.Add(rsu);
+        if (rsuRank[i] == rank) {
+            localRsus.Add(rsu);
+            localRsuIndex.push_back(i);
+        }
+    }
+
+    // Vehicles driving through this rank's segment, with their windows
+    const double segStart = rank * segmentLength;
+    const double segEnd = rank == numRanks - 1 ? scenarioConfig.roadLength : segStart + segmentLength;
+    std::vector<uint32_t> localSpecs;
+    std::vector<std::pair<double, double>> windows;
+    uint32_t handoffs = 0;
+    for (uint32_t i = 0; i < scenario.vehicles.size(); ++i) {
+        const VehicleSpec& spec = scenario.vehicles[i];
+        auto window = SegmentWindow(spec, rank == 0 ? -1e9 : segStart, rank == numRanks - 1 ? 1e9 : segEnd,
+                                    spec.entryTime, std::min(spec.exitTime, simTime - 5));
+        if (window.first >= window.second) {
+            continue;
+        }
+        localSpecs.push_back(i);
+        windows.push_back(window);
+        if (window.first > spec.entryTime) {
+            ++handoffs;
+        }
+    }
+    NodeContainer vehicles;
+    vehicles.Create(localSpecs.size(), rank);
+
+    // RSU to gateway links, on every rank so that the device indices match.
+    // Links of RSUs outside rank 0 become remote channels.
+    PointToPointHelper p2p;
+    p2p.SetDeviceAttribute("DataRate", DataRateValue(DataRate(backhaulRate)));
+    p2p.SetChannelAttribute("Delay", TimeValue(MilliSeconds(backhaulDelay)));
+    std::vector<NetDeviceContainer> backhaulLinks;
+    for (uint32_t i = 0; i < numRSUs; ++i) {
+        backhaulLinks.push_back(p2p.Install(rsus.Get(i), gateways.Get(rsuRank[i])));
+    }
+
+    InternetStackHelper internet;
+    internet.Install(rsus);
+    internet.Install(gateways);
+    internet.Install(aggregator);
+    if (packetCAMs) {
+        PacketSocketHelper packetSocket;
+        packetSocket.Install(vehicles);
+        packetSocket.Install(localRsus);
+    } else {
+        internet.Install(vehicles);
+    }
+
+    // The segment's wireless network, its interface comes first on the RSUs
+    Ptr<GridSpectrumChannel> gridChannel;
+    NetDeviceContainer wifiDevices;
+    {
+        WifiHelper wifiHelper;
+        wifiHelper.SetStandard(WIFI_STANDARD_80211p);
+        NqosWaveMacHelper wifiMac = NqosWaveMacHelper::Default();
+        YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default();
+        YansWifiPhyHelper yansPhy;
+        SpectrumWifiPhyHelper spectrumPhy;
+        WifiPhyHelper* wifiPhy = &yansPhy;
+        const double txPowerDbm = 30.0;
+        if (channel == "yans") {
+            yansPhy.SetChannel(wifiChannel.Create());
+        } else if (channel == "grid") {
+            gridChannel = CreateObject<GridSpectrumChannel>();
+            gridChannel->AddPropagationLossModel(CreateObject<LogDistancePropagationLossModel>());
+            gridChannel->SetPropagationDelayModel(CreateObject<ConstantSpeedPropagationDelayModel>());
+            gridChannel->SetAttribute("MaxSpeed", DoubleValue(scenarioConfig.maxSpeed));
+            if (channelRange > 0) {
+                gridChannel->SetAttribute("MaxRange", DoubleValue(channelRange));
+            } else {
+                gridChannel->SetMaxRangeFromLinkBudget(txPowerDbm, -101.0);
+            }
+            spectrumPhy.SetChannel(gridChannel);
+            wifiPhy = &spectrumPhy;
+        } else {
+            NS_FATAL_ERROR("Unknown channel " << channel);
+        }
+        wifiPhy->Set("TxPowerStart", DoubleValue(txPowerDbm));
+        wifiPhy->Set("TxPowerEnd", DoubleValue(txPowerDbm));
+
+        wifiDevices = wifiHelper.Install(*wifiPhy, wifiMac, NodeContainer(vehicles, localRsus));
+        NetDeviceContainer ipDevices;
+        for (uint32_t i = packetCAMs ? vehicles.GetN() : 0; i < wifiDevices.GetN(); ++i) {
+            ipDevices.Add(wifiDevices.Get(i));
+        }
+        Ipv4AddressHelper wifiAddresses;
+        wifiAddresses.SetBase("10.0.0.0", "255.252.0.0");
+        wifiAddresses.Assign(ipDevices);
+    }
+
+    // Backhaul addresses: a /30 per RSU link, the RSUs route everything that
+    // is not on the wireless network through their gateway
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase("10.128.0.0", "255.255.255.252");
+    Ipv4StaticRoutingHelper staticRouting;
+    for (uint32_t i = 0; i < numRSUs; ++i) {
+        Ipv4InterfaceContainer link = ipv4.Assign(backhaulLinks[i]);
+        ipv4.NewNetwork();
+        if (rsuRank[i] == rank) {
+            staticRouting.GetStaticRouting(rsus.Get(i)->GetObject<Ipv4>())->SetDefaultRoute(link.GetAddress(1), 2);
+        }
+    }
+
+    // Switch, controller and aggregation node, only where they run
+    if (rank == 0) {
+        CsmaHelper csmaHelper;
+        csmaHelper.SetChannelAttribute("DataRate", DataRateValue(DataRate(backhaulRate)));
+        csmaHelper.SetChannelAttribute("Delay", TimeValue(MilliSeconds(2)));
+
+        // Every gateway gets a switch port (ports 1..numRanks), the uplinks follow
+        NetDeviceContainer switchPorts;
+        NetDeviceContainer gatewayDevices;
+        for (uint32_t r = 0; r < numRanks; ++r) {
+            NetDeviceContainer link = csmaHelper.Install(NodeContainer(gateways.Get(r), ofSwitch));
+            gatewayDevices.Add(link.Get(0));
+            switchPorts.Add(link.Get(1));
+        }
+        NetDeviceContainer aggregatorPorts;
+        for (uint32_t i = 0; i < numUplinks; ++i) {
+            NetDeviceContainer link = csmaHelper.Install(NodeContainer(ofSwitch, aggregator));
+            switchPorts.Add(link.Get(0));
+            aggregatorPorts.Add(link.Get(1));
+        }
+        BridgeHelper bridge;
+        NetDeviceContainer aggregatorDevices = bridge.Install(aggregator, aggregatorPorts);
+
+        Ptr<OFSwitch13InternalHelper> of13Helper = CreateObject<OFSwitch13InternalHelper>();
+        Ptr<SDNController> ctrl = CreateObject<SDNController>();
+        ctrl->SetStatsInterval(Seconds(statsInterval));
+        ctrl->SetTargetUtilization(targetUtilization);
+        for (uint32_t r = 0; r < numRanks; ++r) {
+            ctrl->AddRsuPort(r + 1);
+        }
+        for (uint32_t i = 0; i < numUplinks; ++i) {
+            ctrl->AddUplinkPort(numRanks + i + 1, DataRate(backhaulRate));
+        }
+        ctrl->setPort(numRanks + 1);
+        of13Helper->InstallController(ofController, ctrl);
+        of13Helper->InstallSwitch(ofSwitch, switchPorts);
+        of13Helper->CreateOpenFlowChannels();
+
+        ipv4.SetBase("10.254.0.0", "255.255.255.0");
+        ipv4.Assign(gatewayDevices);
+        ipv4.SetBase("10.254.0.0", "255.255.255.0", "0.0.0.254");
+        ipv4.Assign(aggregatorDevices);
+
+        PacketSinkHelper clusterSink("ns3::UdpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), 10));
+        clusterSink.Install(aggregator).Start(Seconds(0.0));
+    }
+
+    // Mobility of the local nodes, the vehicles as in vehicular_network
+    MobilityHelper rsuMobility;
+    rsuMobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+    Ptr<ListPositionAllocator> rsuPositionAlloc = CreateObject<ListPositionAllocator>();
+    for (uint32_t index : localRsuIndex) {
+        rsuPositionAlloc->Add(Vector(scenario.rsus[index].x, scenario.rsus[index].y, 0.0));
+    }
+    rsuMobility.SetPositionAllocator(rsuPositionAlloc);
+    rsuMobility.Install(localRsus);
+
+    MobilityHelper mobility;
+    mobility.SetMobilityModel("ns3::ConstantVelocityMobilityModel");
+    Ptr<ListPositionAllocator> positionAlloc = CreateObject<ListPositionAllocator>();
+    for (uint32_t index : localSpecs) {
+        positionAlloc->Add(Vector(scenario.vehicles[index].x, scenario.vehicles[index].y, 0.0));
+    }
+    mobility.SetPositionAllocator(positionAlloc);
+    mobility.Install(vehicles);
+
+    // A CAM client per vehicle and segment, beaconing to the RSU of the
+    // segment nearest to where the vehicle enters it
+    for (uint32_t v = 0; v < localSpecs.size(); ++v) {
+        const VehicleSpec& spec = scenario.vehicles[localSpecs[v]];
+        vehicles.Get(v)->GetObject<ConstantVelocityMobilityModel>()->SetVelocity(Vector(spec.vx, spec.vy, 0.0));
+
+        double start = windows[v].first;
+        double x = spec.x + spec.vx * start;
+        double y = spec.y + spec.vy * start;
+        uint32_t nearest = 0;
+        double minDist = std::numeric_limits<double>::max();
+        for (uint32_t r = 0; r < localRsus.GetN(); ++r) {
+            const RsuSpec& rsu = scenario.rsus[localRsuIndex[r]];
+            double distance = std::hypot(rsu.x - x, rsu.y - y);
+            if (distance < minDist) {
+                minDist = distance;
+                nearest = r;
+            }
+        }
+
+        Ptr<CAMClient> camClient = CreateObject<CAMClient>();
+        if (packetCAMs) {
+            camClient->SetRemote(wifiDevices.Get(v), wifiDevices.Get(vehicles.GetN() + nearest)->GetAddress());
+        } else {
+            camClient->SetRemote(localRsus.Get(nearest)->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(), 9);
+        }
+        camClient->SetInterval(Seconds(1));
+        camClient->SetLane(spec.lane);
+        camClient->SetVehicleId(localSpecs[v]);
+        camClient->SetDownlinkPort(downlink ? 11 : 0);
+        vehicles.Get(v)->AddApplication(camClient);
+        camClient->SetStartTime(Seconds(start));
+        camClient->SetStopTime(Seconds(windows[v].second));
+    }
+
+    // The final clustering covers the RSUs of this rank
+    for (uint32_t r = 0; r < localRsus.GetN(); ++r) {
+        Ptr<CAMServer> camServer = CreateObject<CAMServer>();
+        if (packetCAMs) {
+            camServer->SetLocal(wifiDevices.Get(vehicles.GetN() + r));
+        } else {
+            camServer->SetLocal(localRsus.Get(r)->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal(), 9);
+        }
+        camServer->SetNumRSUs(localRsus.GetN());
+        camServer->SetClusteringEngine(engine);
+        camServer->SetEpochInterval(Seconds(epochInterval));
+        camServer->SetPrediction(predictionTolerance, maxPredictedEpochs);
+        camServer->SetDownlink(downlink ? 11 : 0);
+        camServer->SetSwitch(AGGREGATOR_ADDRESS, 10);
+        localRsus.Get(r)->AddApplication(camServer);
+        camServer->SetStartTime(Seconds(0.0));
+        camServer->SetStopTime(Seconds(simTime - 5));
+    }
+    NS_LOG_UNCOND("Rank " << rank << ": segment [" << segStart << ", " << segEnd << ") m, " << localRsus.GetN()
+                  << " RSUs, " << localSpecs.size() << " vehicle nodes, " << handoffs << " handed over from other ranks");
+
+    Simulator::Stop(Seconds(simTime));
+    auto wallStart = std::chrono::steady_clock::now();
+    Simulator::Run();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    NS_LOG_UNCOND("Rank " << rank << " simulated " << simTime << " s in " << wallSeconds << " s of wall time");
+    if (gridChannel) {
+        NS_LOG_UNCOND("Rank " << rank << " grid channel scheduled " << gridChannel->GetDeliveries() << " receptions");
+    }
+    Simulator::Destroy();
+    MpiInterface::Disable();
+    return 0;
+}
+
+#else
+
+int main(int argc, char* argv[]){
+    std::cerr << "vehicular_network_mpi needs ns-3 configured with --enable-mpi" << std::endl;
+    return 1;
+}
+
+#endif // NS3_MPI